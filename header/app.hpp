@@ -6,6 +6,15 @@
 #include "sclt.hpp"
 #include "snn.hpp"
 #include "sts.hpp"
+#include "quantize.hpp"
+#include "journal.hpp"
+#include "versions.hpp"
+#include "cache.hpp"
+
+// training requests waiting for the single training worker before OVERLOADED
+#define SNN_SERVER_TRAIN_QUEUE_SIZE 8
+// the server writes its trace on this period instead of after every request
+#define SNN_SERVER_TRACE_SECONDS 10
 
 namespace SNN
 {
@@ -16,6 +25,8 @@ namespace SNN
         SCLT::DoubleVector expected;
         SCLT::DoubleVector output;
         double epsilon = SNN_DEFAULT_EPSILON;
+        // formatted result, kept by the result cache
+        std::string text;
         std::string toString();
     };
 
@@ -25,16 +36,33 @@ namespace SNN
     {
     public:
         Network* network;
+        QuantizedNetwork* quantized = nullptr;
+        WeightJournal* journal = nullptr;
+        VersionedWeights* versions = nullptr;
+        ResultCache* cache = nullptr;
         SCLT::CliArguments* arguments;
         int main(int argc, char **argv);
+        Checks parseChecks();
+        Checks parseChecks(std::string input);
         Checks process();
+        Checks process(Checks checks);
+        void serve(int port);
+        void applyOptimizer();
+        void persist(bool full = false);
+        void writeTrace();
     };
 
+    // Inference requests are answered by several workers from published
+    // snapshots, requests with expected values queue for one training worker,
+    // so a burst of training cannot hold up reads.
     class TcpListener : public STS::TcpListener
     {
     public:
         CliApp* app;
+        int readQueue = 0;
+        int trainQueue = 0;
         void processRequest(STS::TcpRequest* request, STS::TcpResponse* response) override;
+        int getQueue(STS::TcpRequest* request) override;
     };
 };
 
@@ -0,0 +1,84 @@
+#ifndef SNN_BENCH_HPP
+#define SNN_BENCH_HPP
+
+#include <functional>
+#include <vector>
+#include <string>
+#include "sclt.hpp"
+#include "snn.hpp"
+
+#define SNN_BENCH_DEFAULT_MIN_TIME 0.5
+#define SNN_BENCH_DEFAULT_PORT 8765
+#define SNN_BENCH_SEED 4711
+// central difference step and the largest error it may leave
+#define SNN_GRADIENT_CHECK_STEP 1e-5
+#define SNN_GRADIENT_CHECK_TOLERANCE 1e-6
+
+namespace SNN
+{
+    class BenchmarkResult
+    {
+    public:
+        std::string name;
+        long iterations = 0;
+        double seconds = 0;
+        double nsPerOp = 0;
+        double samplesPerSecond = 0;
+        double allocationsPerOp = 0;
+        double bytesPerOp = 0;
+        // training error after the measurement, negative if not evaluated
+        double loss = -1;
+        std::string toJson();
+        std::string toString();
+    };
+
+    class Benchmark
+    {
+    public:
+        std::string name;
+        int samplesPerOp = 1;
+        std::function<void()> operation;
+        std::function<double()> evaluate;
+    };
+
+    class BenchmarkSuite
+    {
+    public:
+        std::vector<Benchmark> benchmarks;
+        double minTime = SNN_BENCH_DEFAULT_MIN_TIME;
+        std::string filter;
+        void add(
+            std::string name,
+            std::function<void()> operation,
+            int samplesPerOp = 1,
+            std::function<double()> evaluate = nullptr
+        );
+        BenchmarkResult measure(Benchmark& benchmark);
+        std::vector<BenchmarkResult> run();
+        std::string toJson(std::vector<BenchmarkResult> results);
+    };
+
+    // Compares the gradients of Engine::backward with central differences of
+    // the loss backward() minimizes: cross-entropy through a softmax output,
+    // half the squared error otherwise. The error of a weight is absolute for
+    // small gradients and relative for large ones.
+    class GradientCheck
+    {
+    public:
+        double step = SNN_GRADIENT_CHECK_STEP;
+        double tolerance = SNN_GRADIENT_CHECK_TOLERANCE;
+        double getLoss(Network* network, Workspace* workspace, const SCLT::DoubleVector& input, const SCLT::DoubleVector& expected);
+        // largest error over all weights
+        double check(Network* network, const SCLT::DoubleVector& input, const SCLT::DoubleVector& expected);
+    };
+
+    class BenchmarkData
+    {
+    public:
+        unsigned int seed = SNN_BENCH_SEED;
+        SCLT::DoubleVector randomVector(int size, double min = 0.0, double max = 1.0);
+        std::string randomChecks(int count, int inputs, int outputs);
+    };
+};
+
+#endif
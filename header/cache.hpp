@@ -0,0 +1,70 @@
+#ifndef SNN_CACHE_HPP
+#define SNN_CACHE_HPP
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "sclt.hpp"
+
+#define SNN_CACHE_SHARDS 16
+#define SNN_DEFAULT_CACHE_ENTRIES 4096
+
+namespace SNN
+{
+    class CachedResult
+    {
+    public:
+        uint64_t hash = 0;
+        SCLT::DoubleVector input;
+        long version = 0;
+        double epsilon = 0;
+        SCLT::DoubleVector output;
+        std::string text;
+    };
+
+    class CacheShard
+    {
+    public:
+        std::mutex mutex;
+        // most recently used first
+        std::list<CachedResult> entries;
+        std::unordered_multimap<uint64_t, std::list<CachedResult>::iterator> index;
+    };
+
+    // Bounded LRU cache of inference results keyed by a hash of the model version,
+    // the input and the epsilon. Entries are compared completely, so a hash collision
+    // is just a miss. Each shard has its own lock, a new model version drops
+    // everything.
+    class ResultCache
+    {
+    public:
+        ResultCache(int capacity = SNN_DEFAULT_CACHE_ENTRIES);
+        int capacity;
+        std::atomic<long> version{-1};
+        std::atomic<long> hits{0};
+        std::atomic<long> misses{0};
+        std::atomic<long> evictions{0};
+        std::atomic<long> invalidations{0};
+        CacheShard shards[SNN_CACHE_SHARDS];
+        static uint64_t Hash(long version, const SCLT::DoubleVector& input, double epsilon);
+        // false for a version older than the current one, its results are not cached
+        bool setVersion(long version);
+        bool get(
+            long version,
+            const SCLT::DoubleVector& input,
+            double epsilon,
+            SCLT::DoubleVector& output,
+            std::string& text
+        );
+        void put(long version, const SCLT::DoubleVector& input, double epsilon, SCLT::DoubleVector output, std::string text);
+        void clear();
+        int size();
+        std::string toString();
+    };
+};
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef SNN_ENGINE_HPP
+#define SNN_ENGINE_HPP
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <string>
+#include "sclt.hpp"
+#include "snn.hpp"
+
+#define SNN_KERNEL_ID_DENSE "Dense"
+#define SNN_KERNEL_ID_SPARSE "Sparse"
+#define SNN_KERNEL_ID_CONVOLUTION "Convolution"
+#define SNN_KERNEL_ID_POOLING "Pooling"
+
+// output positions per im2col block, so the column block of a layer stays in cache
+#define SNN_CONVOLUTION_BLOCK 256
+
+// inputs a dense kernel scans for non-zero values before adding their rows
+#define SNN_DENSE_SLICE 64
+
+// synapses per level before a level is split across the thread pool
+#define SNN_PARALLEL_LEVEL_WORK 32768
+
+#define SNN_LOSS_ID_CROSS_ENTROPY "cross-entropy"
+#define SNN_LOSS_ID_MEAN_SQUARED_ERROR "mse"
+
+namespace SNN
+{
+    // Computes the weighted input sums of one layer from the values of the layer
+    // before. Weights and gradients point at the first parameter of the kernel.
+    // backward() gets the error with respect to the sums (scaledDeltas) and
+    // returns the error with respect to the input values. tile and unroll block
+    // the forward pass, they change the speed but never the result (see
+    // KernelTuner); a tile of 0 is the kernel default.
+    class LayerKernel
+    {
+    public:
+        int inputs = 0;
+        int outputs = 0;
+        int offset = 0;
+        int size = 0;
+        int tile = 0;
+        int unroll = 1;
+        virtual ~LayerKernel() {};
+        virtual std::string getId() = 0;
+        // identifies kernels that are blocked alike, e.g. "Dense:785x10"
+        virtual std::string getShape();
+        // (tile, unroll) candidates worth measuring, none by default
+        virtual std::vector<std::pair<int, int>> getBlockings();
+        virtual void forward(const double* weights, const double* input, double* sums) = 0;
+        // only the sums of the given outputs are needed, by default all are computed
+        virtual void forwardRows(const double* weights, const double* input, double* sums, const int* rows, int count);
+        // flags the inputs the given output reads, by default all of them
+        virtual void markInputs(int output, std::vector<char>& inputs);
+        // appends the parameter ranges [first, last) backward() wrote gradients
+        // to for this input, by default the whole block of the kernel
+        virtual void markGradients(const double* input, const double* scaledDeltas, std::vector<std::pair<int, int>>& ranges);
+        virtual void backward(
+            const double* weights,
+            const double* input,
+            const double* scaledDeltas,
+            double* inputDeltas,
+            double* gradients
+        ) = 0;
+    };
+
+    // fully (or almost fully) connected layer, weights laid out [input][output].
+    // forward() adds unroll input rows per pass over a tile of outputs.
+    class DenseKernel : public LayerKernel
+    {
+    public:
+        SCLT::DoubleVector mask;
+        std::string getId() override;
+        std::vector<std::pair<int, int>> getBlockings() override;
+        void forward(const double* weights, const double* input, double* sums) override;
+        void forwardRows(const double* weights, const double* input, double* sums, const int* rows, int count) override;
+        void markGradients(const double* input, const double* scaledDeltas, std::vector<std::pair<int, int>>& ranges) override;
+        void backward(
+            const double* weights,
+            const double* input,
+            const double* scaledDeltas,
+            double* inputDeltas,
+            double* gradients
+        ) override;
+    };
+
+    // CSR by output neuron for the forward pass plus a CSC view for propagating deltas
+    class SparseKernel : public LayerKernel
+    {
+    public:
+        std::vector<int> rowStart;
+        std::vector<int> columns;
+        std::vector<int> columnStart;
+        std::vector<int> columnRows;
+        std::vector<int> columnPositions;
+        std::string getId() override;
+        void forward(const double* weights, const double* input, double* sums) override;
+        void forwardRows(const double* weights, const double* input, double* sums, const int* rows, int count) override;
+        void markInputs(int output, std::vector<char>& inputs) override;
+        void markGradients(const double* input, const double* scaledDeltas, std::vector<std::pair<int, int>>& ranges) override;
+        void backward(
+            const double* weights,
+            const double* input,
+            const double* scaledDeltas,
+            double* inputDeltas,
+            double* gradients
+        ) override;
+    };
+
+    // im2col: the input windows of a block of output positions are unfolded into
+    // columns [input channel * kernel * kernel][position], so the convolution is a
+    // small dense matrix product per block of tile positions
+    class ConvolutionKernel : public LayerKernel
+    {
+    public:
+        LayerStructure structure;
+        std::string getId() override;
+        std::string getShape() override;
+        std::vector<std::pair<int, int>> getBlockings() override;
+        int getBlock();
+        void unfold(const double* input, double* columns, int first, int count);
+        void fold(const double* columns, double* inputDeltas, int first, int count);
+        void forward(const double* weights, const double* input, double* sums) override;
+        void backward(
+            const double* weights,
+            const double* input,
+            const double* scaledDeltas,
+            double* inputDeltas,
+            double* gradients
+        ) override;
+    };
+
+    // max or average over non-overlapping (or strided) windows of every channel
+    class PoolingKernel : public LayerKernel
+    {
+    public:
+        LayerStructure structure;
+        std::string getId() override;
+        int findMaximum(const double* input, int output);
+        void forward(const double* weights, const double* input, double* sums) override;
+        void backward(
+            const double* weights,
+            const double* input,
+            const double* scaledDeltas,
+            double* inputDeltas,
+            double* gradients
+        ) override;
+    };
+
+    class Workspace
+    {
+    public:
+        std::vector<SCLT::DoubleVector> sums;
+        std::vector<SCLT::DoubleVector> values;
+        std::vector<SCLT::DoubleVector> deltas;
+        std::vector<SCLT::DoubleVector> scaledDeltas;
+    };
+
+    class EngineLayer
+    {
+    public:
+        LayerKernel* kernel = nullptr;
+        std::vector<ActivationFunction*> activationFunctions;
+        std::vector<char> hasInputs;
+        std::vector<char> hasOutputs;
+        bool softmax = false;
+        int size();
+    };
+
+    // Execution plan for any acyclic network. Neurons are numbered in topological
+    // order and grouped into levels whose inputs all come from earlier levels, so
+    // the neurons of a level are independent. The value buffer is indexed by that
+    // number (slot), input synapses are CSR rows in parameter order and output
+    // synapses a CSC view for propagating deltas in the reverse schedule.
+    class LevelSchedule
+    {
+    public:
+        std::vector<int> levelStart;
+        std::vector<int> rowStart;
+        std::vector<int> columns;
+        std::vector<int> outputStart;
+        std::vector<int> outputRows;
+        std::vector<int> outputPositions;
+        std::vector<ActivationFunction*> activationFunctions;
+        std::vector<int> inputIndex;
+        std::vector<int> expectedIndex;
+        std::vector<int> outputSlots;
+        bool softmax = false;
+        int size();
+        void forwardSlot(int slot, const double* weights, Workspace* workspace, const SCLT::DoubleVector& input);
+        void forward(const double* weights, Workspace* workspace, const SCLT::DoubleVector& input);
+        void normalize(Workspace* workspace);
+        void backward(
+            const double* weights,
+            double* gradients,
+            Workspace* workspace,
+            const SCLT::DoubleVector& expectedOutput
+        );
+        void markGradients(Workspace* workspace, std::vector<std::pair<int, int>>& ranges);
+    };
+
+    // The part of the network some outputs depend on. Layered networks list the
+    // needed neurons of every layer (a layer that is needed completely runs its
+    // kernel as usual), a schedule lists the needed slots in schedule order.
+    class OutputCone
+    {
+    public:
+        std::vector<int> outputs;
+        std::vector<std::vector<int>> rows;
+        std::vector<char> complete;
+        std::vector<int> slots;
+    };
+
+    // Compiled execution plan. Strictly layered networks (every synapse goes from
+    // layer l-1 to layer l) run one kernel per layer, everything else runs a
+    // LevelSchedule. Compiling reorders Network::parameters so every kernel
+    // reads one contiguous block. The weights can also be passed per block:
+    // block l is the kernel of layer l, a schedule has a single block 0.
+    class Engine
+    {
+    public:
+        double sparseThreshold = SNN_DEFAULT_SPARSE_THRESHOLD;
+        std::vector<EngineLayer> layers;
+        LevelSchedule* schedule = nullptr;
+        std::map<std::vector<int>, OutputCone*> cones;
+        std::mutex coneMutex;
+        ~Engine();
+        bool isLayered();
+        void compile(Network* network);
+        bool compileLayers(Network* network);
+        void compileSchedule(Network* network);
+        SCLT::DoubleVector getOutput(Workspace* workspace, const OutputCone* cone = nullptr);
+        const OutputCone* getCone(const std::vector<int>& outputs);
+        OutputCone* compileCone(const std::vector<int>& outputs);
+        void prepare(Workspace* workspace);
+        std::vector<int> getBlockOffsets(int parameterCount);
+        void forward(const double* weights, Workspace* workspace, const SCLT::DoubleVector& input);
+        void forward(const double* const* blocks, Workspace* workspace, const SCLT::DoubleVector& input);
+        void forward(
+            const OutputCone* cone,
+            const double* weights,
+            Workspace* workspace,
+            const SCLT::DoubleVector& input
+        );
+        void backward(
+            const double* weights,
+            double* gradients,
+            Workspace* workspace,
+            const SCLT::DoubleVector& expectedOutput
+        );
+        // parameter ranges the last backward() wrote gradients to, in parameter order
+        void markGradients(Workspace* workspace, std::vector<std::pair<int, int>>& ranges);
+        bool hasSoftmaxOutput();
+        // the objective backward() minimizes: cross-entropy through a softmax
+        // output, the mean squared error of the outputs otherwise
+        std::string getLossId();
+        // of the last forward(), read from the workspace in place
+        double getLoss(Workspace* workspace, const SCLT::DoubleVector& expectedOutput);
+    };
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SNN_EXPORT_HPP
+#define SNN_EXPORT_HPP
+
+#include <string>
+#include "snn.hpp"
+
+#define SNN_EXPORT_ALIGNMENT 64
+#define SNN_EXPORT_VALUES_PER_LINE 6
+
+namespace SNN
+{
+    // Writes a dense layered network as a self-contained C++17 header: one
+    // aligned constexpr weight array per layer laid out [input][output] and an
+    // inline process(input, output) with every dimension spelled out. The header
+    // only needs <cmath> and computes the same outputs as Network::process.
+    class HeaderExporter
+    {
+    public:
+        std::string name = "model";
+        std::string generate(Network* network, std::string source = "");
+        void store(Network* network, std::string filePath, std::string source = "");
+        static std::string FormatWeight(double weight);
+        static std::string ToIdentifier(std::string name);
+    };
+};
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef SNN_FIXED_HPP
+#define SNN_FIXED_HPP
+
+#include <array>
+#include <tuple>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include "snn.hpp"
+
+namespace SNN
+{
+    // Activation functions of a FixedLayer, same formulas as the dynamic ones so
+    // that a FixedNetwork computes bit-identical outputs.
+    struct FixedIdentity
+    {
+        static constexpr const char* id = SNN_AF_ID_IDENTITY;
+        static constexpr bool normalizes = false;
+        static inline double activate(double input) { return input; };
+    };
+
+    struct FixedSigmoid
+    {
+        static constexpr const char* id = SNN_AF_ID_SIGMOID;
+        static constexpr bool normalizes = false;
+        static inline double activate(double input) { return 1.0 / (1.0 + std::pow(std::exp(1.0), -input)); };
+    };
+
+    struct FixedHyperbolicTangent
+    {
+        static constexpr const char* id = SNN_AF_ID_HTANGENT;
+        static constexpr bool normalizes = false;
+        static inline double activate(double input)
+        {
+            double epx = std::pow(std::exp(1.0), input);
+            double enx = std::pow(std::exp(1.0), -input);
+            return (epx - enx) / (epx + enx);
+        };
+    };
+
+    // the whole layer is normalized like Softmax::normalize
+    struct FixedSoftmax
+    {
+        static constexpr const char* id = SNN_AF_ID_SOFTMAX;
+        static constexpr bool normalizes = true;
+        static inline double activate(double input) { return input; };
+    };
+
+    template<int Neurons, typename Activation = FixedIdentity>
+    struct FixedLayer
+    {
+        static_assert(Neurons > 0, "a layer needs at least one neuron");
+        static constexpr int size = Neurons;
+        typedef Activation activation;
+    };
+
+    // weight offset of every layer of a FixedNetwork, entry 0 is unused
+    template<int Count>
+    constexpr std::array<int, Count + 1> FixedOffsets(const std::array<int, Count>& sizes)
+    {
+        std::array<int, Count + 1> offsets{};
+        for (int l = 1; l < Count; l++) offsets[l + 1] = offsets[l] + sizes[l - 1] * sizes[l];
+        return offsets;
+    };
+
+    // Dense network with every dimension known at compile time, e.g.
+    // FixedNetwork<FixedLayer<785>, FixedLayer<10, FixedSoftmax>>. Weights are one
+    // std::array laid out [input][output] per layer like DenseKernel and process()
+    // runs on stack buffers, there is no heap allocation or virtual call in the
+    // forward pass. Instances of large networks belong on the heap or in static
+    // storage. Models are imported from and exported to SNN::Network, so the same
+    // model files are used; a missing synapse is a weight of 0.
+    template<typename... Layers>
+    class FixedNetwork
+    {
+    public:
+        static_assert(sizeof...(Layers) >= 2, "a network needs an input and an output layer");
+
+        template<int L>
+        using Layer = typename std::tuple_element<L, std::tuple<Layers...>>::type;
+
+        static constexpr int layerCount = sizeof...(Layers);
+        static constexpr std::array<int, sizeof...(Layers)> sizes = {{Layers::size...}};
+        static constexpr int inputs = sizes.front();
+        static constexpr int outputs = sizes.back();
+
+        static constexpr std::array<int, sizeof...(Layers) + 1> offsets = FixedOffsets<sizeof...(Layers)>(sizes);
+        static constexpr int weightCount = offsets[sizeof...(Layers)];
+        static constexpr int widest = *std::max_element(sizes.begin(), sizes.end());
+
+        std::array<double, weightCount> weights{};
+
+        std::array<double, outputs> process(const std::array<double, inputs>& input) const
+        {
+            std::array<double, widest> even, odd;
+            std::copy(input.begin(), input.end(), even.begin());
+            this->forwardFrom<1>(even.data(), odd.data());
+
+            // layer l is written to odd for odd l
+            const double* last = (layerCount - 1) % 2 == 1 ? odd.data() : even.data();
+            std::array<double, outputs> output;
+            std::copy(last, last + outputs, output.begin());
+            return output;
+        };
+
+        template<int L>
+        inline void forwardFrom(double* input, double* output) const
+        {
+            if constexpr (L < layerCount) {
+                this->forwardLayer<L>(input, output);
+                this->forwardFrom<L + 1>(output, input);
+            }
+        };
+
+        // same summation order as DenseKernel::forward
+        template<int L>
+        inline void forwardLayer(const double* __restrict input, double* __restrict output) const
+        {
+            constexpr int in = sizes[L - 1];
+            constexpr int out = sizes[L];
+            const double* __restrict layerWeights = this->weights.data() + offsets[L];
+            std::fill(output, output + out, 0.0);
+
+            for (int i = 0; i < in; i++) {
+                const double x = input[i];
+                if (x == 0) continue;
+                const double* __restrict row = layerWeights + (long)i * out;
+                for (int o = 0; o < out; o++) output[o] += x * row[o];
+            }
+
+            typedef typename Layer<L>::activation Activation;
+            if constexpr (Activation::normalizes) {
+                double largest = *std::max_element(output, output + out);
+                double total = 0;
+                for (int o = 0; o < out; o++) {
+                    output[o] = std::exp(output[o] - largest);
+                    total += output[o];
+                }
+                double scale = 1.0 / total;
+                for (int o = 0; o < out; o++) output[o] *= scale;
+            } else {
+                for (int o = 0; o < out; o++) output[o] = Activation::activate(output[o]);
+            }
+        };
+
+        static constexpr std::array<const char*, sizeof...(Layers)> GetActivationIds()
+        {
+            return {{Layers::activation::id...}};
+        };
+
+        void importNetwork(Network* network)
+        {
+            auto ids = GetActivationIds();
+            if (network->neurons.size() != layerCount) {
+                throw std::invalid_argument("network has " + std::to_string(network->neurons.size())
+                    + " layers, the fixed network " + std::to_string(layerCount));
+            }
+
+            for (int l = 0; l < layerCount; l++) {
+                if (network->isStructured(l)) {
+                    throw std::invalid_argument("fixed networks do not support " + network->structures[l].type + " layers");
+                }
+                if (network->neurons[l].size() != sizes[l]) {
+                    throw std::invalid_argument("layer " + std::to_string(l) + " has "
+                        + std::to_string(network->neurons[l].size()) + " neurons, the fixed network "
+                        + std::to_string(sizes[l]));
+                }
+            }
+
+            this->weights.fill(0);
+            for (int l = 1; l < layerCount; l++) {
+                for (const auto& neuron : network->neurons[l]) {
+                    auto activationFunction = neuron->activationFunction;
+                    std::string id = activationFunction == nullptr ? SNN_AF_ID_IDENTITY : activationFunction->getId();
+                    if (id != ids[l]) {
+                        throw std::invalid_argument("neuron " + neuron->getId() + " uses " + id
+                            + ", the fixed network " + ids[l]);
+                    }
+
+                    // the engine keeps a neuron without inputs at 0 regardless of its activation
+                    if (neuron->inputSynapses.empty()) {
+                        throw std::invalid_argument("neuron " + neuron->getId() + " has no inputs");
+                    }
+
+                    for (const auto& synapse : neuron->inputSynapses) {
+                        if (synapse->inputNeuron->layer != l - 1) {
+                            throw std::invalid_argument("fixed networks do not support skip connections");
+                        }
+                        this->weights[offsets[l] + (long)synapse->inputNeuron->index * sizes[l] + neuron->index]
+                            += synapse->getWeight();
+                    }
+                }
+            }
+        };
+
+        void exportNetwork(Network* network) const
+        {
+            auto ids = GetActivationIds();
+            network->clear();
+            for (int l = 0; l < layerCount; l++) network->addLayer(sizes[l], l == 0 ? SNN_AF_ID_IDENTITY : ids[l]);
+            network->createSynapses();
+
+            for (int l = 1; l < layerCount; l++) {
+                for (const auto& neuron : network->neurons[l]) {
+                    for (const auto& synapse : neuron->inputSynapses) {
+                        synapse->setWeight(
+                            this->weights[offsets[l] + (long)synapse->inputNeuron->index * sizes[l] + neuron->index]
+                        );
+                    }
+                }
+            }
+        };
+
+        void load(std::string filePath)
+        {
+            Network network;
+            network.load(filePath);
+            this->importNetwork(&network);
+        };
+
+        void store(std::string filePath) const
+        {
+            Network network;
+            this->exportNetwork(&network);
+            network.store(filePath);
+        };
+    };
+};
+
+#endif
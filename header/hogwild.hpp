@@ -0,0 +1,62 @@
+#ifndef SNN_HOGWILD_HPP
+#define SNN_HOGWILD_HPP
+
+#include <atomic>
+#include <vector>
+#include <functional>
+#include "sclt.hpp"
+#include "snn.hpp"
+#include "engine.hpp"
+
+namespace SNN
+{
+    // loss of one worker so far, on its own cache line, so thread 0 can read it
+    // for progress reports while the worker keeps writing
+    class alignas(64) HogwildProgress
+    {
+    public:
+        std::atomic<double> loss{0};
+        std::atomic<long> samples{0};
+    };
+
+    // Asynchronous SGD without locks (Hogwild). Every thread runs forward and
+    // backward passes with its own Workspace and gradient buffer and writes its
+    // update straight into the shared Network::parameters. Reads and writes of
+    // the weights race on purpose: an update lost or read half way is just
+    // noise, which SGD tolerates when updates are sparse. Only the weight rows
+    // of non-zero inputs are written (Engine::markGradients), so a sample costs
+    // what it touches, not the whole model; `updates` counts the written
+    // weights. Needs the SGD optimizer, the state of the other optimizers would
+    // be shared the same way.
+    class HogwildTrainer
+    {
+    public:
+        HogwildTrainer(Network* network, int threads = 0);
+        ~HogwildTrainer();
+        Network* network;
+        int threads;
+        // pin worker t to CpuTopology::getCpu(t)
+        bool pinned = false;
+        std::vector<Workspace*> workspaces;
+        std::vector<SCLT::DoubleVector> gradients;
+        long updates = 0;
+        // mean Engine::getLoss of the forward passes of the last train()
+        double loss = 0;
+        // thread 0 calls onReport with the samples taken so far and their mean
+        // loss since the last report, every reportInterval samples (0 never)
+        int reportInterval = 0;
+        std::function<void(long samples, double loss)> onReport;
+        void train(
+            const std::vector<SCLT::DoubleVector>& inputs,
+            const std::vector<SCLT::DoubleVector>& expectedOutputs,
+            double epsilon
+        );
+        static double MeanSquaredError(
+            Network* network,
+            const std::vector<SCLT::DoubleVector>& inputs,
+            const std::vector<SCLT::DoubleVector>& expectedOutputs
+        );
+    };
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SNN_JOURNAL_HPP
+#define SNN_JOURNAL_HPP
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include "sclt.hpp"
+#include "snn.hpp"
+
+#define SNN_JOURNAL_SUFFIX ".journal"
+#define SNN_JOURNAL_SEALED_SUFFIX ".journal.sealed"
+#define SNN_JOURNAL_MAGIC "SNNJ1\n"
+// compact once the journal has grown to this share of the snapshot size
+#define SNN_DEFAULT_JOURNAL_COMPACT_RATIO 1.0
+
+namespace SNN
+{
+    // Incremental persistence of a model file. snapshot() stores the whole network,
+    // commit() appends the weights that changed since the last commit as binary
+    // (parameter id, value) records. Values are absolute, so replaying a record
+    // twice is harmless. Every journal segment has a generation and a snapshot
+    // already contains all segments below its own journal generation. Optimizer
+    // state is only part of snapshots.
+    class WeightJournal
+    {
+    public:
+        WeightJournal(Network* network, std::string filePath);
+        ~WeightJournal();
+        Network* network;
+        std::string filePath;
+        double compactRatio = SNN_DEFAULT_JOURNAL_COMPACT_RATIO;
+        SCLT::DoubleVector persisted;
+        long structureVersion = -1;
+        long generation = 0;
+        long journalBytes = 0;
+        long snapshotBytes = 0;
+        long committedRecords = 0;
+        std::ofstream segment;
+        std::thread compaction;
+        std::atomic<bool> compacting{false};
+        void open();
+        void snapshot();
+        int commit();
+        void compact();
+        void wait();
+        void remember();
+        void startSegment();
+        static long ReadGeneration(std::string journalPath);
+        static long Replay(Network* network, std::string journalPath);
+        static std::string Merge(std::string snapshot, std::string journalPath, long generation);
+    };
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef SNN_LOADGEN_HPP
+#define SNN_LOADGEN_HPP
+
+#include <vector>
+#include <string>
+#include "sclt.hpp"
+#include "sts.hpp"
+
+#define SNN_LOADGEN_DEFAULT_CONNECTIONS 4
+#define SNN_LOADGEN_DEFAULT_SECONDS 10
+#define SNN_LOADGEN_DEFAULT_CHECKS 10
+#define SNN_LOADGEN_DEFAULT_INPUTS 3
+#define SNN_LOADGEN_PAYLOADS 1000
+
+namespace SNN
+{
+    class LoadResult
+    {
+    public:
+        long requests = 0;
+        long errors = 0;
+        // answered OVERLOADED or EXPIRED by the server
+        long rejected = 0;
+        long expired = 0;
+        double seconds = 0;
+        // seconds per answered request, sorted
+        SCLT::DoubleVector latencies;
+        double getThroughput();
+        double getPercentile(double share);
+        std::string toJson();
+        std::string toString();
+    };
+
+    // Drives an STS::TcpServer with concurrent connections, one thread each.
+    // Closed loop (rate 0) sends the next request as soon as the previous answer
+    // arrived. Open loop schedules request i at i / rate seconds after the start
+    // and measures its latency from that point, so time spent waiting for a free
+    // connection counts as well and a saturated server cannot hide its queue.
+    class LoadGenerator
+    {
+    public:
+        std::string host = "127.0.0.1";
+        int port = STC_DEFAULT_PORT;
+        int connections = SNN_LOADGEN_DEFAULT_CONNECTIONS;
+        // requests per second over all connections
+        double rate = 0;
+        double seconds = SNN_LOADGEN_DEFAULT_SECONDS;
+        // stop after this many requests, 0 for no limit
+        long limit = 0;
+        // sent with every request in ms, 0 for the server default
+        int deadline = 0;
+        // sent in turn
+        SCLT::StringVector payloads;
+        void synthesize(int count, int checks, int inputs, int outputs, uint64_t seed);
+        void replay(std::string filePath);
+        LoadResult run();
+    };
+};
+
+#endif
@@ -1,10 +1,17 @@
 #ifndef SNN_MNIST_HPP
 #define SNN_MNIST_HPP
 
+#include <functional>
 #include <vector>
 #include <string>
 #include "snn.hpp"
 
+#define SNN_MNIST_CALIBRATION_SIZE 1000
+#define SNN_MNIST_DEFAULT_NETWORK "785;10,Softmax"
+#define SNN_MNIST_VALIDATION_SHARE 0.1
+#define SNN_MNIST_DEFAULT_PATIENCE 3
+#define SNN_MNIST_REPORT_INTERVAL 10000
+
 namespace SNN
 {
     class MNIST_Digit
@@ -24,25 +31,60 @@ namespace SNN
         MNIST_ByteVector readAllBytes(std::string filename);
     };
 
-    class MNIST_ProbabilityDigit
-    {
-    public:
-        int digit;
-        float probability;
-    };
-
-    bool MNIST_ProbabilityDigitCompare(MNIST_ProbabilityDigit a, MNIST_ProbabilityDigit b);
-
     class MNIST_Test
     {
     public:
         MNIST_DataSet digitsTrain;
         MNIST_DataSet digitsTest;
+        // held out of digitsTrain, decides which epochs are checkpointed
+        MNIST_DataSet digitsValidation;
         MNIST_Decoder* decoder = new MNIST_Decoder;
         Network* network = new Network;
+        std::function<void()> onEpoch;
+        std::string optimizer;
+        std::string definition = SNN_MNIST_DEFAULT_NETWORK;
+        double epsilon = SNN_DEFAULT_EPSILON;
+        double decay = 0.9;
+        // train with this many lock-free threads instead of sequential SGD
+        int hogwildThreads = 0;
+        bool pinned = false;
+        // train() and test() print no progress, e.g. when stdout carries other results
+        bool quiet = false;
+        double validationShare = SNN_MNIST_VALIDATION_SHARE;
+        // epochs without a better validation accuracy before execute() stops, 0 never stops
+        int patience = SNN_MNIST_DEFAULT_PATIENCE;
+        // 0 for no limit
+        int maxEpochs = 0;
+        // training samples between two progress lines
+        int reportInterval = SNN_MNIST_REPORT_INTERVAL;
+        // the JSON summary of execute() is also written here
+        std::string summaryPath;
+        // loss and speed of the last train(), lossId names the loss (see Engine::getLossId)
+        std::string lossId;
+        double trainLoss = 0;
+        double samplesPerSecond = 0;
 
-        void test();
+        SCLT::DoubleVector toInput(MNIST_Digit& digit);
+        float evaluate(MNIST_DataSet& digits, std::function<SCLT::DoubleVector(SCLT::DoubleVector)> process = nullptr);
+        float test(std::function<SCLT::DoubleVector(SCLT::DoubleVector)> process = nullptr);
+        void train(double epsilon);
+        void splitValidation();
+        void createNetwork();
+        void loadData(std::string mnistFilesRootPath);
+        void loadNetwork(std::string networkSaveFilePath);
         void execute(std::string networkSaveFilePath, std::string mnistFilesRootPath);
+        void prune(
+            std::string networkSaveFilePath,
+            std::string mnistFilesRootPath,
+            double targetSparsity,
+            int steps,
+            bool perLayer = false
+        );
+        void quantize(
+            std::string networkSaveFilePath,
+            std::string mnistFilesRootPath,
+            int calibrationSize = SNN_MNIST_CALIBRATION_SIZE
+        );
     };
 };
 
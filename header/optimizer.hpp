@@ -0,0 +1,95 @@
+#ifndef SNN_OPTIMIZER_HPP
+#define SNN_OPTIMIZER_HPP
+
+#include <vector>
+#include <string>
+#include "sclt.hpp"
+#include "snn.hpp"
+
+#define SNN_OPTIMIZER_ID_SGD "SGD"
+#define SNN_OPTIMIZER_ID_MOMENTUM "Momentum"
+#define SNN_OPTIMIZER_ID_NESTEROV "Nesterov"
+#define SNN_OPTIMIZER_ID_ADAM "Adam"
+#define SNN_OPTIMIZER_ID_ADAMW "AdamW"
+
+#define SNN_SAVE_COMMAND_OPTIMIZER "OP"
+#define SNN_SAVE_COMMAND_OPTIMIZER_STATE "OS"
+
+#define SNN_DEFAULT_MOMENTUM 0.9
+#define SNN_DEFAULT_BETA1 0.9
+#define SNN_DEFAULT_BETA2 0.999
+#define SNN_DEFAULT_ADAM_EPSILON 1e-8
+#define SNN_DEFAULT_WEIGHT_DECAY 0.01
+
+namespace SNN
+{
+    // every state variable is a contiguous buffer indexed like Parameters::weights,
+    // so update() can apply gradients and state in a single pass
+    class Optimizer
+    {
+    public:
+        std::vector<SCLT::DoubleVector> state;
+        long steps = 0;
+        virtual ~Optimizer() {};
+        virtual std::string getId() = 0;
+        virtual int getStateSize();
+        virtual SCLT::DoubleVector getHyperParameters();
+        virtual void setHyperParameters(SCLT::DoubleVector values);
+        virtual void update(double* weights, double* gradients, int size, double rate) = 0;
+        void step(Parameters* parameters, double rate);
+        void reset();
+        void remap(const std::vector<int>& source);
+        SCLT::PBag store(std::vector<int> order);
+        void loadSettings(SCLT::PBag arguments);
+        void loadState(SCLT::PBag arguments);
+        static Optimizer* create(std::string definition);
+    };
+
+    class SGD : public Optimizer
+    {
+    public:
+        std::string getId() override;
+        void update(double* weights, double* gradients, int size, double rate) override;
+    };
+
+    class Momentum : public Optimizer
+    {
+    public:
+        double momentum = SNN_DEFAULT_MOMENTUM;
+        std::string getId() override;
+        int getStateSize() override;
+        SCLT::DoubleVector getHyperParameters() override;
+        void setHyperParameters(SCLT::DoubleVector values) override;
+        void update(double* weights, double* gradients, int size, double rate) override;
+    };
+
+    class Nesterov : public Momentum
+    {
+    public:
+        std::string getId() override;
+        void update(double* weights, double* gradients, int size, double rate) override;
+    };
+
+    class Adam : public Optimizer
+    {
+    public:
+        double beta1 = SNN_DEFAULT_BETA1;
+        double beta2 = SNN_DEFAULT_BETA2;
+        double epsilon = SNN_DEFAULT_ADAM_EPSILON;
+        double weightDecay = 0;
+        std::string getId() override;
+        int getStateSize() override;
+        SCLT::DoubleVector getHyperParameters() override;
+        void setHyperParameters(SCLT::DoubleVector values) override;
+        void update(double* weights, double* gradients, int size, double rate) override;
+    };
+
+    class AdamW : public Adam
+    {
+    public:
+        AdamW();
+        std::string getId() override;
+    };
+};
+
+#endif
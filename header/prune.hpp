@@ -0,0 +1,35 @@
+#ifndef SNN_PRUNE_HPP
+#define SNN_PRUNE_HPP
+
+#include <functional>
+#include <map>
+#include "snn.hpp"
+
+#define SNN_DEFAULT_PRUNE_STEPS 5
+
+namespace SNN
+{
+    // Magnitude pruning: synapses whose absolute weight is below the threshold of
+    // their layer (the layer of the output neuron) are removed, then hidden
+    // neurons left without inputs or outputs, then the storage is compacted.
+    class Pruner
+    {
+    public:
+        double threshold = 0;
+        std::map<int, double> layerThresholds;
+        bool perLayer = false;
+        int prune(Network* network);
+        double getThreshold(int layer);
+        double magnitudeQuantile(Network* network, double sparsity, int layer = -1);
+        void setSparsity(Network* network, double sparsity);
+        int countSynapses(Network* network);
+        void schedule(
+            Network* network,
+            double targetSparsity,
+            int steps = SNN_DEFAULT_PRUNE_STEPS,
+            std::function<void(int step)> finetune = nullptr
+        );
+    };
+};
+
+#endif
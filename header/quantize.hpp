@@ -0,0 +1,54 @@
+#ifndef SNN_QUANTIZE_HPP
+#define SNN_QUANTIZE_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "sclt.hpp"
+#include "snn.hpp"
+
+#define SNN_QUANTIZED_FILE_SUFFIX ".q8"
+#define SNN_QUANTIZED_MAGIC "SNNQ8\n"
+#define SNN_QUANTIZED_WEIGHT_MAX 127
+// activations use 7 bits so pmaddubsw can never saturate its 16 bit pair sums
+#define SNN_QUANTIZED_ACTIVATION_MAX 127
+#define SNN_QUANTIZED_ROW_ALIGNMENT 32
+
+namespace SNN
+{
+    class QuantizedLayer
+    {
+    public:
+        int inputs = 0;
+        int outputs = 0;
+        int paddedInputs = 0;
+        double inputScale = 1;
+        int inputZeroPoint = 0;
+        std::vector<int8_t> weights;
+        std::vector<int32_t> rowSums;
+        SCLT::DoubleVector rowScales;
+        std::vector<ActivationFunction*> activationFunctions;
+        std::vector<char> hasInputs;
+        bool softmax = false;
+    };
+
+    // Inference-only int8 copy of a layered Network: per output row weight scales,
+    // per layer activation scales from calibration and int32 accumulation.
+    class QuantizedNetwork
+    {
+    public:
+        QuantizedNetwork(ActivationFunctionRegistry* afRegistry = nullptr);
+        ActivationFunctionRegistry* afRegistry;
+        int inputs = 0;
+        std::vector<QuantizedLayer> layers;
+        void quantize(Network* network, std::vector<SCLT::DoubleVector> calibrationInputs);
+        SCLT::DoubleVector process(SCLT::DoubleVector input);
+        void store(std::string filePath);
+        void load(std::string filePath);
+    };
+
+    int32_t DotProductU8S8(const uint8_t* a, const int8_t* b, int size);
+    std::string DotProductImplementation();
+};
+
+#endif
@@ -5,6 +5,13 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cstdint>
 
 #define SCLT_PARAM_BAG_L1_DELIMITER ';'
 #define SCLT_PARAM_BAG_L2_DELIMITER ','
@@ -13,6 +20,8 @@
 #define SCLT_PBAG_2_DELIMITER {';',','}
 #define SCLT_PBAG_1_DELIMITER {','}
 
+#define SCLT_SLAB_SIZE 1024
+
 namespace SCLT
 {
     typedef std::vector<char> CharVector;
@@ -29,6 +38,106 @@ namespace SCLT
     void WriteToFile(std::string path, std::string contents);
     std::string ReadFromFile(std::string path);
 
+    // counter based random numbers: the same (seed, counter) pair always yields the
+    // same value, so ranges can be generated in any order and on any thread
+    uint64_t RandomHash(uint64_t seed, uint64_t counter);
+    double RandomUniform(uint64_t seed, uint64_t counter);
+    double RandomNormal(uint64_t seed, uint64_t counter);
+
+    // NUMA nodes and their cpus from sysfs, limited to the cpus this process may
+    // run on. Without NUMA information all online cpus form a single node.
+    class CpuTopology
+    {
+    public:
+        std::vector<int> nodeIds;
+        std::vector<std::vector<int>> nodes;
+        void discover();
+        int size();
+        int getNode(int worker);
+        int getCpu(int worker);
+        int getCurrentNode();
+        static std::vector<int> ParseCpuList(std::string list);
+        static CpuTopology* shared();
+    };
+
+    // pins the calling thread to one cpu, false if that is not possible
+    bool PinThread(int cpu);
+
+    class ThreadPool
+    {
+    public:
+        ThreadPool(int threads = 0, bool pinned = false);
+        ~ThreadPool();
+        // pin the workers of shared() to cpus spread over the NUMA nodes, has to
+        // be set before its first use
+        static bool pinShared;
+        bool pinned = false;
+        int size();
+        void parallelFor(int begin, int end, std::function<void(int, int)> body, int minChunk = 1);
+        static ThreadPool* shared();
+
+    protected:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::mutex submitMutex;
+        std::condition_variable wakeUp;
+        std::condition_variable finished;
+        std::function<void(int, int)> body;
+        std::atomic<int> nextChunk;
+        int chunks = 0;
+        int chunkSize = 0;
+        int begin = 0;
+        int end = 0;
+        int pending = 0;
+        long generation = 0;
+        bool stopping = false;
+        void work(int worker);
+        void runChunks();
+    };
+
+    // Objects of one type carved out of blocks of SCLT_SLAB_SIZE. Released objects
+    // are reset and handed out again, clear() frees every block in one step.
+    template<typename T>
+    class Slab
+    {
+    public:
+        Slab() {};
+        Slab(const Slab&) = delete;
+        Slab& operator=(const Slab&) = delete;
+        std::vector<std::unique_ptr<T[]>> blocks;
+        std::vector<T*> released;
+        int used = 0;
+
+        T* create()
+        {
+            if (!this->released.empty()) {
+                T* object = this->released.back();
+                this->released.pop_back();
+                return object;
+            }
+
+            if (this->blocks.empty() || this->used == SCLT_SLAB_SIZE) {
+                this->blocks.emplace_back(new T[SCLT_SLAB_SIZE]);
+                this->used = 0;
+            }
+
+            return &this->blocks.back()[this->used++];
+        };
+
+        void release(T* object)
+        {
+            *object = T();
+            this->released.push_back(object);
+        };
+
+        void clear()
+        {
+            this->blocks.clear();
+            this->released.clear();
+            this->used = 0;
+        };
+    };
+
     class PBag
     {
     public:
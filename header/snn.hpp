@@ -3,33 +3,63 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <string>
+#include <functional>
 #include "sclt.hpp"
 
 #define SNN_AF_ID_IDENTITY "Identity"
 #define SNN_AF_ID_BOOLEAN "Boolean"
 #define SNN_AF_ID_SIGMOID "Sigmoid"
 #define SNN_AF_ID_HTANGENT "HTangent"
+#define SNN_AF_ID_SOFTMAX "Softmax"
+
+#define SNN_INIT_ID_UNIFORM "Uniform"
+#define SNN_INIT_ID_XAVIER "Xavier"
+#define SNN_INIT_ID_HE "He"
+
+#define SNN_LAYER_ID_DENSE "Dense"
+#define SNN_LAYER_ID_CONVOLUTION "Conv"
+#define SNN_LAYER_ID_MAX_POOL "MaxPool"
+#define SNN_LAYER_ID_AVG_POOL "AvgPool"
 
 #define SNN_NEURON_ID_DELIMITER '-'
+#define SNN_LAYER_DEFINITION_DELIMITER ':'
 
 #define SNN_SAVE_COMMAND_ADD_NEURON "AN"
 #define SNN_SAVE_COMMAND_ADD_SYNAPSE "AS"
+#define SNN_SAVE_COMMAND_ADD_LAYER "AL"
+#define SNN_SAVE_COMMAND_JOURNAL_GENERATION "JG"
 
 #define SNN_DEFAULT_EPSILON 0.01
+#define SNN_DEFAULT_SEED 1
+#define SNN_DEFAULT_INITIALIZER SNN_INIT_ID_XAVIER
+#define SNN_PARALLEL_INIT_CHUNK 16384
+// model files are parsed in slices of at least this many bytes, one per thread
+#define SNN_LOAD_CHUNK_BYTES (1 << 20)
+
+// layers with fewer synapses than this share of all possible connections run as CSR
+#define SNN_DEFAULT_SPARSE_THRESHOLD 0.25
 
 namespace SNN
 {
     class Neuron;
+    class Optimizer;
+    class Engine;
+    class Workspace;
+    class KernelTuner;
 
     typedef std::vector<Neuron*> NeuronLayer;
 
     class ActivationFunction
     {
     public:
+        virtual ~ActivationFunction() {};
         virtual std::string getId() = 0;
         virtual double activate(double input) = 0;
-        virtual double derivative(double input) = 0;
+        // slope at the weighted input sum, value is activate(sum) from the same
+        // forward pass so the derivative never has to activate again
+        virtual double derivative(double sum, double value) = 0;
     };
 
     class Identity : public ActivationFunction
@@ -37,7 +67,7 @@ namespace SNN
     public:
         std::string getId() override;
         double activate(double input) override;
-        double derivative(double input) override;
+        double derivative(double sum, double value) override;
     };
 
     class Boolean : public ActivationFunction
@@ -45,7 +75,7 @@ namespace SNN
     public:
         std::string getId() override;
         double activate(double input) override;
-        double derivative(double input) override;
+        double derivative(double sum, double value) override;
     };
 
     class Sigmoid : public ActivationFunction
@@ -53,7 +83,7 @@ namespace SNN
     public:
         std::string getId() override;
         double activate(double input) override;
-        double derivative(double input) override;
+        double derivative(double sum, double value) override;
     };
 
     class HyperbolicTangent : public ActivationFunction
@@ -61,64 +91,179 @@ namespace SNN
     public:
         std::string getId() override;
         double activate(double input) override;
-        double derivative(double input) override;
+        double derivative(double sum, double value) override;
+    };
+
+    // Works on the whole output layer: activate() passes the sum through and the
+    // layer is normalized in one max-subtracted pass by normalize(). Trained with
+    // cross-entropy, whose gradient with respect to the sums is expected - value,
+    // so derivative() is 1.
+    class Softmax : public ActivationFunction
+    {
+    public:
+        std::string getId() override;
+        double activate(double input) override;
+        double derivative(double sum, double value) override;
+        static bool isLayer(const std::vector<ActivationFunction*>& activationFunctions);
+        static void normalize(const double* sums, double* values, int size);
     };
 
     class ActivationFunctionRegistry
     {
     public:
+        ~ActivationFunctionRegistry();
         std::map<std::string, ActivationFunction*> registry;
         void add(ActivationFunction* activationFunction);
+        bool has(std::string id);
         ActivationFunction* get(std::string id);
     };
 
+    // ids follow the parameters through every remap: the position of the weight
+    // in the last stored or loaded model file, -1 if it was never persisted
+    class Parameters
+    {
+    public:
+        SCLT::DoubleVector weights;
+        SCLT::DoubleVector gradients;
+        std::vector<int> ids;
+        int add(double weight = 0.0);
+        int size();
+        void clear();
+        void remap(const std::vector<int>& source);
+    };
+
     class Synapse
     {
     public:
         Neuron* inputNeuron;
         Neuron* outputNeuron;
-        double previousWeight = 0;
-        double weight = 0;
-        double getValue();
+        Parameters* parameters = nullptr;
+        int index = 0;
+        double getWeight();
+        void setWeight(double weight);
     };
 
+    // identified by (layer, index), the file id "N-<layer>-<index>" is only
+    // formatted for storing
     class Neuron
     {
     public:
-        std::string id;
+        int layer = 0;
+        int index = 0;
         std::vector<Synapse*> inputSynapses;
         std::vector<Synapse*> outputSynapses;
         ActivationFunction* activationFunction = nullptr;
-        bool cacheValue = false;
-        double value = 0;
-        double smallDelta = 0;
-        void reset();
+        std::string getId();
         bool isInput();
         bool isOutput();
-        double getValue();
-        void learn(double expectedValue, double epsilon = SNN_DEFAULT_EPSILON);
     };
 
+    // Spatial layout of a layer as [channel][row][column] and, for convolution
+    // and pooling layers, the window reading the layer before. Those layers have
+    // no synapses, their weights are one block of Network::parameters laid out
+    // [output channel][input channel][row][column].
+    class LayerStructure
+    {
+    public:
+        std::string type = SNN_LAYER_ID_DENSE;
+        int channels = 1;
+        int height = 1;
+        int width = 1;
+        int inputChannels = 1;
+        int inputHeight = 1;
+        int inputWidth = 1;
+        int kernel = 1;
+        int stride = 1;
+        int padding = 0;
+        int offset = 0;
+        int size = 0;
+        bool isStructured();
+        int getNeuronCount();
+        int getInputCount();
+        int getWindowSize();
+    };
+
+    int ArgMax(const SCLT::DoubleVector& output);
+    std::vector<int> TopK(const SCLT::DoubleVector& output, int k);
+    std::vector<int> MaskIndices(const std::vector<bool>& mask);
+
     class Network
     {
     public:
         Network(ActivationFunctionRegistry* afRegistry = nullptr);
+        Network(const Network&) = delete;
+        Network& operator=(const Network&) = delete;
+        ~Network();
         ActivationFunctionRegistry* afRegistry;
+        bool ownsRegistry = false;
         std::vector<NeuronLayer> neurons;
+        SCLT::Slab<Neuron> neuronSlab;
+        SCLT::Slab<Synapse> synapseSlab;
+        Parameters parameters;
+        Optimizer* optimizer = nullptr;
+        uint64_t seed = SNN_DEFAULT_SEED;
+        std::map<int, std::string> initializers;
+        std::map<int, LayerStructure> structures;
+        std::shared_ptr<Engine> engine;
+        Workspace* workspace = nullptr;
+        bool compiled = false;
+        long structureVersion = 0;
+        // counts training steps and structure changes, results can be cached per version
+        long weightVersion = 0;
+        long journalGeneration = 0;
+        double sparseThreshold = SNN_DEFAULT_SPARSE_THRESHOLD;
+        // picks the kernel blockings of every compiled engine, not owned
+        KernelTuner* tuner = nullptr;
+        void invalidate();
+        void compile();
+        void setOptimizer(std::string definition);
         Neuron* addNeuron(int layer, std::string activationFunctionId = SNN_AF_ID_IDENTITY);
+        Neuron* getNeuron(int layer, int index);
         Neuron* getNeuron(std::string id);
         Synapse* addSynapse(Neuron* leftNeuron, Neuron* rightNeuron, double weight = 0.0);
+        int removeSynapses(std::function<bool(Synapse*)> predicate);
+        int removeDeadNeurons();
+        void compact();
         void initLayerUpTo(int layer);
-        void addLayer(int numberOfNeurons = 1, std::string activationFunctionId = SNN_AF_ID_IDENTITY);
+        void clear();
+        bool isStructured(int layer);
+        void addLayer(
+            int numberOfNeurons = 1,
+            std::string activationFunctionId = SNN_AF_ID_IDENTITY,
+            std::string initializerId = SNN_DEFAULT_INITIALIZER
+        );
+        void addShapedLayer(
+            int channels,
+            int height,
+            int width,
+            std::string activationFunctionId = SNN_AF_ID_IDENTITY,
+            std::string initializerId = SNN_DEFAULT_INITIALIZER
+        );
+        void addConvolutionLayer(
+            int channels,
+            int kernel,
+            int stride = 1,
+            int padding = 0,
+            std::string activationFunctionId = SNN_AF_ID_IDENTITY,
+            std::string initializerId = SNN_DEFAULT_INITIALIZER
+        );
+        void addPoolingLayer(
+            std::string type,
+            int size,
+            int stride = 0,
+            std::string activationFunctionId = SNN_AF_ID_IDENTITY
+        );
         void store(std::string filePath);
         void load(std::string filePath);
         void loadShort(std::string definition);
         void createSynapses();
+        void initializeWeights(int layerId, int firstIndex, int lastIndex, int fanIn, int fanOut);
         SCLT::DoubleVector process(
             SCLT::DoubleVector input,
             SCLT::DoubleVector expectedOutput = {},
             double epsilon = SNN_DEFAULT_EPSILON
         );
+        SCLT::DoubleVector processOutputs(SCLT::DoubleVector input, const std::vector<int>& outputs);
     };
 };
 
@@ -0,0 +1,64 @@
+#ifndef SPT_HPP
+#define SPT_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define SPT_RING_CAPACITY 65536
+
+// scopes compile to nothing unless the build enables tracing (cmake -DSNN_TRACING=ON)
+#ifdef SPT_ENABLE
+#define SPT_CONCAT_INNER(a, b) a##b
+#define SPT_CONCAT(a, b) SPT_CONCAT_INNER(a, b)
+#define SPT_SCOPE(name) SPT::Scope SPT_CONCAT(sptScope, __LINE__)(name)
+#define SPT_SCOPE_ARG(name, arg) SPT::Scope SPT_CONCAT(sptScope, __LINE__)(name, arg)
+#else
+#define SPT_SCOPE(name)
+#define SPT_SCOPE_ARG(name, arg)
+#endif
+
+namespace SPT
+{
+    struct Event
+    {
+        const char* name;
+        int arg;
+        long long start;
+        long long duration;
+    };
+
+    // Written only by its own thread. Other threads read it while it is written:
+    // written is published after the event, and snapshot() drops the events that
+    // were overwritten while it copied them. Reset() only moves cleared.
+    class RingBuffer
+    {
+    public:
+        int thread = 0;
+        std::vector<Event> events;
+        std::atomic<long long> written{0};
+        std::atomic<long long> cleared{0};
+        void push(const Event& event);
+        std::vector<Event> snapshot();
+    };
+
+    class Scope
+    {
+    public:
+        const char* name;
+        int arg;
+        long long start;
+        Scope(const char* name, int arg = -1);
+        ~Scope();
+    };
+
+    void Enable(bool enabled = true);
+    bool IsEnabled();
+    long long Now();
+    void Reset();
+    std::string ToChromeJson();
+    std::string ToSummary();
+    void WriteChromeJson(std::string path);
+}
+
+#endif
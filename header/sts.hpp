@@ -1,24 +1,72 @@
 #ifndef STS_HPP
 #define STS_HPP
 
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <vector>
+#include <condition_variable>
+#include <netinet/in.h>
 
 #define STC_DEFAULT_PORT 8000
-#define STC_HOLD_CONNECTIONS 10
+// connections the kernel holds before accept, admission happens in the queues
+#define STC_HOLD_CONNECTIONS 128
 #define STC_REQUEST_BUFFER_SIZE 1000
+#define STC_READ_TIMEOUT_MS 1000
+#define STC_DEFAULT_QUEUE_SIZE 64
+#define STC_DEFAULT_DEADLINE_MS 1000
+// optional first line of a request with its deadline in ms, e.g. "DEADLINE 50\n"
+#define STC_DEADLINE_PREFIX "DEADLINE "
+#define STC_RESPONSE_OVERLOADED "OVERLOADED\n"
+#define STC_RESPONSE_EXPIRED "EXPIRED\n"
+// followed by the reason, a request the listeners failed on
+#define STC_RESPONSE_ERROR "ERROR "
 
 namespace STS
 {
-    struct TcpRequest { std::string body;};
+    struct TcpRequest
+    {
+        std::string body;
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    };
     struct TcpResponse { std::string body; };
 
     class TcpListener
     {
     public:
         virtual void processRequest(TcpRequest* request, TcpResponse* response) = 0;
+        // index of the queue a request waits in, asked before it is admitted
+        virtual int getQueue(TcpRequest* request) { return 0; };
+    };
+
+    // Bounded queue of accepted connections with its own worker threads
+    class TcpQueue
+    {
+    public:
+        TcpQueue(int capacity, int workers);
+        int capacity;
+        int workers;
+        std::deque<std::pair<int, TcpRequest*>> pending;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::atomic<long> admitted{0};
+        std::atomic<long> rejected{0};
+        std::atomic<long> expired{0};
+        std::atomic<long> served{0};
+        std::atomic<long> failed{0};
     };
 
+    // The accepting thread polls the accepted connections and reads each request
+    // once it arrived, so a slow client never holds up the others; a connection
+    // silent for STC_READ_TIMEOUT_MS is closed. It asks the listeners for the
+    // queue of the request and answers OVERLOADED right away when that queue is
+    // full. Workers answer
+    // EXPIRED instead of processing a request whose deadline passed while it
+    // waited, so under overload the latency of served requests stays bounded
+    // by the deadline. A request a listener throws on is answered "ERROR <reason>".
+    // Without addQueue() there is one default queue.
     class TcpServer
     {
     protected:
@@ -26,8 +74,27 @@ namespace STS
         TcpResponse* processRequest(TcpRequest* request);
 
     public:
+        std::vector<TcpQueue*> queues;
+        // default deadline in ms from the arrival of a request, 0 for none
+        int deadline = STC_DEFAULT_DEADLINE_MS;
+        // pin worker w to SCLT::CpuTopology::getCpu(w)
+        bool pinned = false;
         void addRequestEventListener(TcpListener* listener);
+        int addQueue(int capacity = STC_DEFAULT_QUEUE_SIZE, int workers = 1);
+        void readRequest(int connection, TcpRequest* request, std::chrono::steady_clock::time_point arrival);
+        bool admit(int connection, TcpRequest* request);
+        void work(TcpQueue* queue);
         void listen(int port = STC_DEFAULT_PORT);
+        std::string toString();
+    };
+
+    // one request per connection, the server closes it after the response
+    class TcpClient
+    {
+    public:
+        TcpClient(std::string host = "127.0.0.1", int port = STC_DEFAULT_PORT);
+        sockaddr_in address;
+        std::string request(const std::string& body);
     };
 };
 
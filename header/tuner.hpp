@@ -0,0 +1,45 @@
+#ifndef SNN_TUNER_HPP
+#define SNN_TUNER_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "sclt.hpp"
+#include "snn.hpp"
+#include "engine.hpp"
+
+#define SNN_TUNER_UNKNOWN_CPU "unknown"
+// time spent measuring one blocking of one kernel
+#define SNN_TUNER_SAMPLE_SECONDS 0.01
+// measuring rounds over all candidates, the fastest round of each counts
+#define SNN_TUNER_ROUNDS 3
+
+namespace SNN
+{
+    // Picks the fastest forward blocking (LayerKernel::tile and unroll) of every
+    // kernel of a compiled engine. The first time a kernel shape is seen on a cpu
+    // model every candidate is measured on the real weights; the winners are kept
+    // in a PBag file of "cpu,shape,tile,unroll" records and reused by later runs.
+    // Assign it to Network::tuner to tune every compiled engine.
+    class KernelTuner
+    {
+    public:
+        KernelTuner(std::string filePath);
+        std::string filePath;
+        std::string cpuModel;
+        double sampleSeconds = SNN_TUNER_SAMPLE_SECONDS;
+        std::map<std::string, std::pair<int, int>> blockings;
+        std::mutex mutex;
+        long measured = 0;
+        long reused = 0;
+        void load();
+        void store();
+        void tune(Engine* engine, const double* weights);
+        std::pair<int, int> measure(LayerKernel* kernel, const double* weights);
+        std::string getKey(LayerKernel* kernel);
+        static std::string ReadCpuModel();
+    };
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef SNN_VERSIONS_HPP
+#define SNN_VERSIONS_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "sclt.hpp"
+#include "snn.hpp"
+#include "engine.hpp"
+
+namespace SNN
+{
+    // Immutable weights of one published version, one block per engine layer
+    // (see Engine::getBlockOffsets). Blocks that did not change are shared with
+    // the versions before.
+    class WeightSnapshot
+    {
+    public:
+        long version = 0;
+        std::shared_ptr<Engine> engine;
+        std::vector<std::shared_ptr<const SCLT::DoubleVector>> blocks;
+        std::vector<const double*> pointers;
+        SCLT::DoubleVector process(Workspace* workspace, const SCLT::DoubleVector& input) const;
+    };
+
+    // Copy of a published snapshot owned by one NUMA node
+    class NodeReplica
+    {
+    public:
+        std::shared_ptr<const WeightSnapshot> source;
+        std::shared_ptr<const WeightSnapshot> local;
+    };
+
+    // Copy-on-write publishing of Network::parameters for concurrent readers. The
+    // trainer keeps changing the network and calls publish(), readers pin() the
+    // latest snapshot and run it with their own Workspace. A pinned snapshot
+    // never changes, publishing only swaps the current pointer. With replicate
+    // set, pinLocal() hands out a copy of the snapshot on the NUMA node of the
+    // calling thread instead of the single shared one.
+    class VersionedWeights
+    {
+    public:
+        VersionedWeights(Network* network);
+        Network* network;
+        std::shared_ptr<const WeightSnapshot> current;
+        std::vector<std::vector<std::shared_ptr<SCLT::DoubleVector>>> pages;
+        std::mutex mutex;
+        bool replicate = false;
+        std::vector<NodeReplica> replicas;
+        std::mutex replicaMutex;
+        long copiedBlocks = 0;
+        long sharedBlocks = 0;
+        std::shared_ptr<const WeightSnapshot> pin();
+        std::shared_ptr<const WeightSnapshot> pinLocal();
+        long publish();
+        std::shared_ptr<SCLT::DoubleVector> getPage(int block, int size);
+    };
+};
+
+#endif
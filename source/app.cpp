@@ -1,9 +1,20 @@
 #include <iostream>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <stdexcept>
 #include "../header/app.hpp"
 #include "../header/snn.hpp"
 #include "../header/sclt.hpp"
 #include "../header/sts.hpp"
+#include "../header/prune.hpp"
+#include "../header/quantize.hpp"
+#include "../header/journal.hpp"
+#include "../header/versions.hpp"
+#include "../header/cache.hpp"
+#include "../header/tuner.hpp"
+#include "../header/spt.hpp"
 
 namespace SNN
 {
@@ -12,15 +23,24 @@ namespace SNN
         STS::TcpResponse* response
     )
     {
-        this->app->arguments->set("checks", request->body);
-        auto checks = this->app->process();
+        auto checks = this->app->process(this->app->parseChecks(request->body));
         for (auto& check : checks) {
             response->body += check.toString() + "\n";
         }
     };
 
+    int TcpListener::getQueue(STS::TcpRequest* request)
+    {
+        // only checks with expected values have a second field, the int8 copy never trains
+        bool training = this->app->quantized == nullptr
+            && request->body.find(SCLT_PARAM_BAG_L1_DELIMITER) != std::string::npos;
+        return training ? this->trainQueue : this->readQueue;
+    };
+
     std::string Check::toString()
     {
+        if (!this->text.empty()) return this->text;
+
         SCLT::PBag outputBag;
         outputBag.insert(SCLT::dvtosv(this->input));
         outputBag.insert(SCLT::dvtosv(this->expected));
@@ -34,34 +54,105 @@ namespace SNN
         this->network = new Network;
         this->arguments = new SCLT::CliArguments(argc, argv, {
             {'f', "file", "file for storing network", true},
-            {'n', "network", "network definition (e.g. \"3;10,sigmoid;1\"; not used when --file exists!)", true},
+            {'n', "network", "network definition (e.g. \"3;10,Sigmoid,Xavier;1\"; not used when --file exists!)", true},
+            {'r', "seed", "seed for the weight initialization of --network", true},
             {'c', "checks", "checks to run (e.g. \"1,1,1;3;0.01_1,2,3;6:0.01\")", true},
+            {'o', "optimizer", "optimizer and settings (e.g. \"Adam\" or \"Momentum,0.9\"; default SGD)", true},
+            {'p', "prune", "remove this share of the smallest weights and dead neurons (e.g. 0.8)", true},
+            {'l', "prune-per-layer", "apply the --prune share to every layer instead of globally"},
+            {'j', "journal", "append changed weights to a journal next to --file instead of storing it completely"},
+            {'q', "quantize", "store an int8 copy of --file calibrated on the --checks inputs and run the checks on it"},
+            {'Q', "quantized", "run checks or server on the int8 copy of --file (inference only)"},
+            {'C', "cache", "cache the results of this many checks without expected values", true},
             {'s', "server", "specify port to run in server mode", true},
+            {'P', "pin", "pin this thread and the worker threads to cpus spread over the NUMA nodes"},
+            {'R', "replicate", "server readers use a copy of the published weights on their own NUMA node instead of one shared copy"},
+            {'u', "tune", "measure kernel blockings for this host on first use and cache them in this file", true},
+            {'w', "workers", "server threads answering inference requests (default one per cpu)", true},
+            {'b', "backlog", "inference requests the server queues before answering OVERLOADED (default 64)", true},
+            {'d', "deadline", "default request deadline of the server in ms, later requests are answered EXPIRED (default 1000, 0 for none)", true},
+            {'t', "trace", "write a chrome trace to file (rewritten every 10 s in server mode)", true},
+            {'T', "trace-summary", "print aggregated trace timings to stderr"},
             {'h', "help", "blubb"}
         }, 25);
 
+        SPT::Enable(this->arguments->has("trace") || this->arguments->has("trace-summary"));
+
+        if (this->arguments->has("pin")) {
+            SCLT::ThreadPool::pinShared = true;
+            SCLT::PinThread(SCLT::CpuTopology::shared()->getCpu(0));
+        }
+
         try {
+            if (this->arguments->has("tune")) {
+                this->network->tuner = new KernelTuner(this->arguments->get("tune"));
+            }
+
+            if (this->arguments->has("journal")) {
+                if (!this->arguments->has("file")) {
+                    throw std::invalid_argument("--journal needs --file");
+                }
+                this->journal = new WeightJournal(this->network, this->arguments->get("file"));
+            }
+
             if (this->arguments->has("file")
                 && SCLT::FileExists(this->arguments->get("file"))
             ) {
-                this->network->load(this->arguments->get("file"));
+                if (this->journal != nullptr) {
+                    this->journal->open();
+                } else {
+                    this->network->load(this->arguments->get("file"));
+                }
+                this->applyOptimizer();
 
             } else if (this->arguments->has("network")) {
-                this->network->loadShort(this->arguments->get("network"));
-                if (this->arguments->has("file")) {
-                    this->network->store(this->arguments->get("file"));
+                if (this->arguments->has("seed")) {
+                    this->network->seed = std::stoull(this->arguments->get("seed"));
                 }
+                this->network->loadShort(this->arguments->get("network"));
+                this->applyOptimizer();
+                this->persist(true);
 
             } else {
                 throw std::invalid_argument("you have to provide --file or --network");
             }
 
+            if (this->arguments->has("prune")) {
+                Pruner pruner;
+                pruner.perLayer = this->arguments->has("prune-per-layer");
+                pruner.setSparsity(this->network, std::stod(this->arguments->get("prune")));
+                int removed = pruner.prune(this->network);
+                std::cerr << "pruned " << removed << " synapses" << std::endl;
+                this->persist(true);
+            }
+
+            if (this->arguments->has("quantize") || this->arguments->has("quantized")) {
+                if (!this->arguments->has("file")) {
+                    throw std::invalid_argument("--quantize and --quantized need --file");
+                }
+
+                std::string quantizedPath = this->arguments->get("file") + SNN_QUANTIZED_FILE_SUFFIX;
+                this->quantized = new QuantizedNetwork(this->network->afRegistry);
+
+                if (this->arguments->has("quantize")) {
+                    std::vector<SCLT::DoubleVector> calibrationInputs;
+                    for (auto& check : this->parseChecks()) {
+                        calibrationInputs.push_back(check.input);
+                    }
+                    this->quantized->quantize(this->network, calibrationInputs);
+                    this->quantized->store(quantizedPath);
+                    std::cerr << "stored int8 network (" << DotProductImplementation() << ")" << std::endl;
+                } else {
+                    this->quantized->load(quantizedPath);
+                }
+            }
+
+            if (this->arguments->has("cache")) {
+                this->cache = new ResultCache(std::stoi(this->arguments->get("cache")));
+            }
+
             if (this->arguments->has("server")) {
-                auto listener = new TcpListener;
-                listener->app = this;
-                auto server = new STS::TcpServer;
-                server->addRequestEventListener(listener);
-                server->listen(std::stoi(this->arguments->get("server")));
+                this->serve(std::stoi(this->arguments->get("server")));
                 return 0;
             }
 
@@ -71,6 +162,9 @@ namespace SNN
                 std::cout << check.toString() << std::endl;
             }
 
+            if (this->journal != nullptr) this->journal->wait();
+            this->writeTrace();
+
         } catch (std::exception& e) {
             std::cout << e.what() << "\n" << this->arguments->getHelp(25) << std::endl;
             return EXIT_FAILURE;
@@ -79,47 +173,179 @@ namespace SNN
         return 0;
     };
 
-    Checks CliApp::process()
+    Checks CliApp::parseChecks()
+    {
+        if (!this->arguments->has("checks")) return {};
+        return this->parseChecks(this->arguments->get("checks"));
+    };
+
+    Checks CliApp::parseChecks(std::string input)
     {
         Checks checks;
+        SCLT::PBag checksInput;
+        {
+            SPT_SCOPE("parse");
+            checksInput = SCLT::PBag::fromString(input, SCLT_PBAG_3_DELIMITER);
+        }
 
-        if (this->arguments->has("checks")) {
-            auto checksInput = SCLT::PBag::fromString(
-                this->arguments->get("checks"),
-                SCLT_PBAG_3_DELIMITER
-            );
+        for (auto& checkInput : checksInput) {
+            Check check;
+            check.epsilon = SNN_DEFAULT_EPSILON;
 
-            for (auto& checkInput : checksInput) {
-                Check check;
-                check.epsilon = SNN_DEFAULT_EPSILON;
+            if (checkInput.size() < 1) continue;
+            check.input = checkInput[0].toDoubleVector();
 
-                if (checkInput.size() < 1) continue;
-                check.input = checkInput[0].toDoubleVector();
+            if (checkInput.size() > 1) {
+                check.expected = checkInput[1].toDoubleVector();
+            }
 
-                if (checkInput.size() > 1) {
-                    check.expected = checkInput[1].toDoubleVector();
+            if (checkInput.size() > 2) {
+                const std::string& epsilon = checkInput[2][0].value;
+                char* end = nullptr;
+                check.epsilon = std::strtod(epsilon.c_str(), &end);
+                if (epsilon.empty() || *end != '\0' || !std::isfinite(check.epsilon)) {
+                    throw std::invalid_argument("invalid epsilon \"" + epsilon + "\"");
                 }
+            }
 
-                if (checkInput.size() > 2) {
-                    check.epsilon = std::stod(checkInput[2][0].value);
-                }
+            checks.push_back(check);
+        }
+
+        return checks;
+    };
 
-                checks.push_back(check);
+    Checks CliApp::process()
+    {
+        return this->process(this->parseChecks());
+    };
+
+    // Server workers call this concurrently for inference checks, training
+    // checks only ever come from the single training worker.
+    Checks CliApp::process(Checks checks)
+    {
+        // buffers of the thread reading snapshots
+        static thread_local Workspace workspace;
+        bool trained = false;
+        bool unpublished = false;
+
+        for (auto& check : checks) {
+            if (this->quantized == nullptr && !check.expected.empty()) {
+                check.output = this->network->process(
+                    check.input,
+                    check.expected,
+                    check.epsilon
+                );
+                trained = true;
+                unpublished = this->versions != nullptr;
+                continue;
+            }
+
+            // inference checks read published snapshots, so they never see a half trained layer
+            std::shared_ptr<const WeightSnapshot> snapshot;
+            if (this->quantized == nullptr && this->versions != nullptr) {
+                if (unpublished) this->versions->publish();
+                unpublished = false;
+                snapshot = this->versions->pinLocal();
+            }
+
+            // the int8 copy never changes, the network with every training step
+            long version = 0;
+            if (snapshot != nullptr) {
+                version = snapshot->version;
+            } else if (this->quantized == nullptr) {
+                version = this->network->weightVersion;
+            }
+
+            bool cached = this->cache != nullptr && check.expected.empty() && this->cache->setVersion(version);
+            if (cached) {
+                if (this->cache->get(version, check.input, check.epsilon, check.output, check.text)) continue;
+            }
+
+            if (this->quantized != nullptr) {
+                check.output = this->quantized->process(check.input);
+            } else if (snapshot != nullptr) {
+                check.output = snapshot->process(&workspace, check.input);
+            } else {
+                check.output = this->network->process(check.input);
+            }
+
+            if (cached) {
+                check.text = check.toString();
+                this->cache->put(version, check.input, check.epsilon, check.output, check.text);
             }
         }
 
-        for (auto& check : checks) {
-            check.output = this->network->process(
-                check.input,
-                check.expected,
-                check.epsilon
-            );
+        if (unpublished) this->versions->publish();
+        if (trained) this->persist();
+
+        return checks;
+    };
+
+    void CliApp::serve(int port)
+    {
+        this->versions = new VersionedWeights(this->network);
+        this->versions->replicate = this->arguments->has("replicate");
+        this->versions->publish();
+
+        auto server = new STS::TcpServer;
+        auto listener = new TcpListener;
+        listener->app = this;
+
+        int workers = SCLT::ThreadPool::shared()->size();
+        int backlog = STC_DEFAULT_QUEUE_SIZE;
+        if (this->arguments->has("workers")) workers = std::stoi(this->arguments->get("workers"));
+        if (this->arguments->has("backlog")) backlog = std::stoi(this->arguments->get("backlog"));
+        if (this->arguments->has("deadline")) server->deadline = std::stoi(this->arguments->get("deadline"));
+        server->pinned = this->arguments->has("pin");
+
+        // training changes the network in place, one worker at a time
+        listener->readQueue = server->addQueue(backlog, std::max(1, workers));
+        listener->trainQueue = server->addQueue(SNN_SERVER_TRAIN_QUEUE_SIZE, 1);
+
+        // writing the trace takes a while, the workers keep tracing meanwhile
+        if (SPT::IsEnabled()) {
+            std::thread([this, server]() {
+                while (true) {
+                    std::this_thread::sleep_for(std::chrono::seconds(SNN_SERVER_TRACE_SECONDS));
+                    this->writeTrace();
+                    if (this->arguments->has("trace-summary")) std::cerr << server->toString() << std::endl;
+                }
+            }).detach();
+        }
+
+        server->addRequestEventListener(listener);
+        server->listen(port);
+    };
+
+    void CliApp::applyOptimizer()
+    {
+        if (this->arguments->has("optimizer")) {
+            this->network->setOptimizer(this->arguments->get("optimizer"));
         }
+    };
 
-        if (checks.size() > 0 && this->arguments->has("file")) {
+    void CliApp::persist(bool full)
+    {
+        if (!this->arguments->has("file")) return;
+
+        if (this->journal == nullptr) {
             this->network->store(this->arguments->get("file"));
+        } else if (full) {
+            this->journal->snapshot();
+        } else {
+            this->journal->commit();
+        }
+    };
+
+    void CliApp::writeTrace()
+    {
+        if (this->arguments->has("trace")) {
+            SPT::WriteChromeJson(this->arguments->get("trace"));
         }
 
-        return checks;
+        if (this->arguments->has("trace-summary")) {
+            std::cerr << SPT::ToSummary() << std::endl;
+            if (this->cache != nullptr) std::cerr << this->cache->toString() << std::endl;
+        }
     };
 };
@@ -0,0 +1,703 @@
+#include <iostream>
+#include <cmath>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
+#include "../header/bench.hpp"
+#include "../header/mnist.hpp"
+#include "../header/app.hpp"
+#include "../header/sts.hpp"
+#include "../header/quantize.hpp"
+#include "../header/journal.hpp"
+#include "../header/versions.hpp"
+#include "../header/cache.hpp"
+#include "../header/fixed.hpp"
+#include "../header/hogwild.hpp"
+#include "../header/tuner.hpp"
+#include "../header/prune.hpp"
+
+// every heap allocation of the benchmark binary is counted here
+static std::atomic<long> allocationCount(0);
+static std::atomic<long> allocationBytes(0);
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
+};
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+};
+
+void operator delete(void* pointer, std::size_t size) noexcept
+{
+    std::free(pointer);
+};
+
+namespace SNN
+{
+    std::string BenchmarkResult::toJson()
+    {
+        return "{\"name\":\"" + this->name + "\""
+            + ",\"iterations\":" + std::to_string(this->iterations)
+            + ",\"seconds\":" + std::to_string(this->seconds)
+            + ",\"ns_per_op\":" + std::to_string(this->nsPerOp)
+            + ",\"samples_per_sec\":" + std::to_string(this->samplesPerSecond)
+            + ",\"allocs_per_op\":" + std::to_string(this->allocationsPerOp)
+            + ",\"bytes_per_op\":" + std::to_string(this->bytesPerOp)
+            + (this->loss < 0 ? "" : ",\"loss\":" + std::to_string(this->loss))
+            + "}";
+    };
+
+    std::string BenchmarkResult::toString()
+    {
+        std::string line = this->name;
+        if (line.size() < 36) line.insert(line.end(), 36 - line.size(), ' ');
+        return line
+            + std::to_string(this->nsPerOp) + " ns/op  "
+            + std::to_string(this->samplesPerSecond) + " samples/s  "
+            + std::to_string(this->allocationsPerOp) + " allocs/op"
+            + (this->loss < 0 ? "" : "  loss " + std::to_string(this->loss));
+    };
+
+    void BenchmarkSuite::add(
+        std::string name,
+        std::function<void()> operation,
+        int samplesPerOp,
+        std::function<double()> evaluate
+    )
+    {
+        Benchmark benchmark;
+        benchmark.name = name;
+        benchmark.operation = operation;
+        benchmark.samplesPerOp = samplesPerOp;
+        benchmark.evaluate = evaluate;
+        this->benchmarks.push_back(benchmark);
+    };
+
+    BenchmarkResult BenchmarkSuite::measure(Benchmark& benchmark)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        // warm up caches and lazily built state
+        benchmark.operation();
+
+        BenchmarkResult result;
+        result.name = benchmark.name;
+
+        long batch = 1;
+        long allocations = allocationCount.load();
+        long bytes = allocationBytes.load();
+        auto start = Clock::now();
+        double elapsed = 0;
+
+        while (elapsed < this->minTime) {
+            for (long i = 0; i < batch; i++) benchmark.operation();
+            result.iterations += batch;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            if (batch < 1024) batch *= 2;
+        }
+
+        result.seconds = elapsed;
+        result.nsPerOp = elapsed * 1e9 / result.iterations;
+        result.samplesPerSecond = result.iterations * benchmark.samplesPerOp / elapsed;
+        result.allocationsPerOp = (double)(allocationCount.load() - allocations) / result.iterations;
+        result.bytesPerOp = (double)(allocationBytes.load() - bytes) / result.iterations;
+        if (benchmark.evaluate) result.loss = benchmark.evaluate();
+        return result;
+    };
+
+    std::vector<BenchmarkResult> BenchmarkSuite::run()
+    {
+        std::vector<BenchmarkResult> results;
+        for (auto& benchmark : this->benchmarks) {
+            if (!this->filter.empty() && benchmark.name.find(this->filter) == std::string::npos) {
+                continue;
+            }
+            auto result = this->measure(benchmark);
+            std::cerr << result.toString() << std::endl;
+            results.push_back(result);
+        }
+        return results;
+    };
+
+    std::string BenchmarkSuite::toJson(std::vector<BenchmarkResult> results)
+    {
+        std::string json = "{\"benchmarks\":[";
+        bool first = true;
+        for (auto& result : results) {
+            if (!first) json += ",";
+            first = false;
+            json += "\n  " + result.toJson();
+        }
+        return json + "\n]}\n";
+    };
+
+    SCLT::DoubleVector BenchmarkData::randomVector(int size, double min, double max)
+    {
+        std::mt19937 generator(this->seed++);
+        std::uniform_real_distribution<double> distribution(min, max);
+        SCLT::DoubleVector vector;
+        for (int i = 0; i < size; i++) vector.push_back(distribution(generator));
+        return vector;
+    };
+
+    std::string BenchmarkData::randomChecks(int count, int inputs, int outputs)
+    {
+        SCLT::PBag checks;
+        for (int i = 0; i < count; i++) {
+            SCLT::PBag check;
+            check.insert(SCLT::dvtosv(this->randomVector(inputs)));
+            if (outputs > 0) check.insert(SCLT::dvtosv(this->randomVector(outputs)));
+            checks.insert(check);
+        }
+        return checks.toString(SCLT_PBAG_3_DELIMITER);
+    };
+
+    double GradientCheck::getLoss(
+        Network* network,
+        Workspace* workspace,
+        const SCLT::DoubleVector& input,
+        const SCLT::DoubleVector& expected
+    )
+    {
+        network->engine->forward(network->parameters.weights.data(), workspace, input);
+        auto output = network->engine->getOutput(workspace);
+        bool crossEntropy = network->engine->hasSoftmaxOutput();
+
+        double loss = 0;
+        for (int o = 0; o < output.size() && o < expected.size(); o++) {
+            if (crossEntropy) {
+                loss -= expected[o] * std::log(output[o]);
+            } else {
+                loss += 0.5 * (expected[o] - output[o]) * (expected[o] - output[o]);
+            }
+        }
+        return loss;
+    };
+
+    double GradientCheck::check(Network* network, const SCLT::DoubleVector& input, const SCLT::DoubleVector& expected)
+    {
+        if (!network->compiled) network->compile();
+
+        Workspace workspace;
+        auto& weights = network->parameters.weights;
+        SCLT::DoubleVector gradients(weights.size(), 0);
+        network->engine->forward(weights.data(), &workspace, input);
+        network->engine->backward(weights.data(), gradients.data(), &workspace, expected);
+
+        // padding slots of a masked dense kernel are no synapses, they never learn
+        std::vector<char> synapses(weights.size(), 1);
+        for (const auto& layer : network->engine->layers) {
+            auto dense = dynamic_cast<DenseKernel*>(layer.kernel);
+            if (dense == nullptr) continue;
+            for (int slot = 0; slot < dense->mask.size(); slot++) synapses[dense->offset + slot] = dense->mask[slot] != 0;
+        }
+
+        double largest = 0;
+        for (int k = 0; k < weights.size(); k++) {
+            if (!synapses[k]) continue;
+            double weight = weights[k];
+            weights[k] = weight + this->step;
+            double above = this->getLoss(network, &workspace, input, expected);
+            weights[k] = weight - this->step;
+            double below = this->getLoss(network, &workspace, input, expected);
+            weights[k] = weight;
+
+            double numeric = (above - below) / (2 * this->step);
+            double scale = std::max(1.0, std::max(std::fabs(numeric), std::fabs(gradients[k])));
+            largest = std::max(largest, std::fabs(numeric - gradients[k]) / scale);
+        }
+        return largest;
+    };
+};
+
+static std::string SendRequest(int port, const std::string& body)
+{
+    return STS::TcpClient("127.0.0.1", port).request(body);
+};
+
+// keeps pure forward passes from being optimized away
+static volatile double fixedSink = 0;
+
+static void AddNetworkBenchmarks(SNN::BenchmarkSuite& suite, SNN::BenchmarkData& data)
+{
+    SCLT::StringVector topologies = {
+        "3;10,Sigmoid;1",
+        "785;10,Sigmoid",
+        "785;10,Softmax",
+        "785;128,Sigmoid;10,Sigmoid"
+    };
+
+    for (const auto& topology : topologies) {
+        auto network = new SNN::Network;
+        network->loadShort(topology);
+        auto input = data.randomVector(network->neurons.front().size());
+        auto expected = data.randomVector(network->neurons.back().size());
+
+        suite.add("forward/" + topology, [network, input]() {
+            network->process(input);
+        });
+
+        suite.add("train/" + topology, [network, input, expected]() {
+            network->process(input, expected, SNN_DEFAULT_EPSILON);
+        });
+
+        auto quantized = new SNN::QuantizedNetwork(network->afRegistry);
+        quantized->quantize(network, {input, data.randomVector(input.size())});
+
+        suite.add("forward-int8/" + topology, [quantized, input]() {
+            quantized->process(input);
+        });
+    }
+
+    for (const auto& optimizer : {"Momentum", "Nesterov", "Adam", "AdamW"}) {
+        auto network = new SNN::Network;
+        network->loadShort("785;10,Sigmoid");
+        network->setOptimizer(optimizer);
+        auto input = data.randomVector(785);
+        auto expected = data.randomVector(10);
+
+        suite.add("train/785;10,Sigmoid/" + std::string(optimizer), [network, input, expected]() {
+            network->process(input, expected, SNN_DEFAULT_EPSILON);
+        });
+    }
+
+    // same models with every dimension known at compile time
+    typedef SNN::FixedNetwork<SNN::FixedLayer<785>, SNN::FixedLayer<10, SNN::FixedSoftmax>> FixedSoftmaxNetwork;
+    typedef SNN::FixedNetwork<
+        SNN::FixedLayer<785>,
+        SNN::FixedLayer<128, SNN::FixedSigmoid>,
+        SNN::FixedLayer<10, SNN::FixedSigmoid>
+    > FixedHiddenNetwork;
+
+    auto softmax = new SNN::Network;
+    softmax->loadShort("785;10,Softmax");
+    auto fixedSoftmax = new FixedSoftmaxNetwork;
+    fixedSoftmax->importNetwork(softmax);
+    auto hidden = new SNN::Network;
+    hidden->loadShort("785;128,Sigmoid;10,Sigmoid");
+    auto fixedHidden = new FixedHiddenNetwork;
+    fixedHidden->importNetwork(hidden);
+
+    std::array<double, 785> fixedInput;
+    auto fixedValues = data.randomVector(785);
+    std::copy(fixedValues.begin(), fixedValues.end(), fixedInput.begin());
+
+    suite.add("forward-fixed/785;10,Softmax", [fixedSoftmax, fixedInput]() {
+        auto output = fixedSoftmax->process(fixedInput);
+        fixedSink = output[0];
+    });
+
+    suite.add("forward-fixed/785;128,Sigmoid;10,Sigmoid", [fixedHidden, fixedInput]() {
+        auto output = fixedHidden->process(fixedInput);
+        fixedSink = output[0];
+    });
+
+    for (const auto& fill : {0.05, 0.2, 0.5}) {
+        auto network = new SNN::Network;
+        network->addLayer(785);
+        network->addLayer(256, SNN_AF_ID_SIGMOID);
+        network->addLayer(10, SNN_AF_ID_SIGMOID);
+        uint64_t counter = 0;
+        for (int l = 1; l < 3; l++) {
+            for (const auto& left : network->neurons[l - 1]) {
+                for (const auto& right : network->neurons[l]) {
+                    counter++;
+                    if (l == 2 || SCLT::RandomUniform(data.seed + 1, counter) < fill) {
+                        network->addSynapse(left, right, SCLT::RandomUniform(data.seed, counter) - 0.5);
+                    }
+                }
+            }
+        }
+        data.seed += 2;
+
+        auto input = data.randomVector(785);
+        auto expected = data.randomVector(10);
+        std::string name = "785;256@" + std::to_string((int)(fill * 100)) + "%;10";
+
+        suite.add("forward/" + name, [network, input]() {
+            network->process(input);
+        });
+
+        suite.add("train/" + name, [network, input, expected]() {
+            network->process(input, expected, SNN_DEFAULT_EPSILON);
+        });
+    }
+
+    // input to output skip connections make the network run as a level schedule
+    auto skip = new SNN::Network;
+    skip->loadShort("785;128,Sigmoid;10,Sigmoid");
+    uint64_t counter = 0;
+    for (const auto& left : skip->neurons[0]) {
+        for (const auto& right : skip->neurons[2]) {
+            skip->addSynapse(left, right, SCLT::RandomUniform(data.seed, counter++) - 0.5);
+        }
+    }
+    data.seed++;
+    auto skipInput = data.randomVector(785);
+    auto skipExpected = data.randomVector(10);
+
+    suite.add("forward/785;128,Sigmoid;10,Sigmoid+skip", [skip, skipInput]() {
+        skip->process(skipInput);
+    });
+
+    suite.add("train/785;128,Sigmoid;10,Sigmoid+skip", [skip, skipInput, skipExpected]() {
+        skip->process(skipInput, skipExpected, SNN_DEFAULT_EPSILON);
+    });
+
+    suite.add("forward-cone/785;128,Sigmoid;10,Sigmoid+skip", [skip, skipInput]() {
+        skip->processOutputs(skipInput, {3});
+    });
+
+    for (const auto& topology : {
+        "1:28:28;Conv:8:5:1:2,Sigmoid,He;MaxPool:2;10,Sigmoid",
+        "1:28:28;Conv:8:3,Sigmoid,He;AvgPool:2;Conv:16:3,Sigmoid,He;MaxPool:2;10,Sigmoid"
+    }) {
+        auto network = new SNN::Network;
+        network->loadShort(topology);
+        auto input = data.randomVector(network->neurons.front().size());
+        auto expected = data.randomVector(network->neurons.back().size());
+
+        suite.add("forward/" + std::string(topology), [network, input]() {
+            network->process(input);
+        });
+
+        suite.add("train/" + std::string(topology), [network, input, expected]() {
+            network->process(input, expected, SNN_DEFAULT_EPSILON);
+        });
+    }
+
+    auto wide = new SNN::Network;
+    wide->loadShort("785;2048,Sigmoid;10,Sigmoid");
+    auto wideInput = data.randomVector(785);
+
+    suite.add("forward/785;2048,Sigmoid;10,Sigmoid", [wide, wideInput]() {
+        wide->process(wideInput);
+    });
+
+    // blockings measured for this host, the outputs stay the same
+    auto tuner = new SNN::KernelTuner("/tmp/snn-bench-" + std::to_string(getpid()) + ".tune");
+    for (const auto& topology : {
+        "785;2048,Sigmoid;10,Sigmoid",
+        "1:28:28;Conv:8:5:1:2,Sigmoid,He;MaxPool:2;10,Sigmoid"
+    }) {
+        auto tuned = new SNN::Network;
+        tuned->loadShort(topology);
+        tuned->tuner = tuner;
+        tuned->compile();
+        auto input = data.randomVector(tuned->neurons.front().size());
+
+        suite.add("forward-tuned/" + std::string(topology), [tuned, input]() {
+            tuned->process(input);
+        });
+    }
+    std::remove(tuner->filePath.c_str());
+
+    auto persisted = new SNN::Network;
+    persisted->loadShort("785;10,Sigmoid");
+    std::string path = "/tmp/snn-bench-" + std::to_string(getpid()) + ".nn";
+    persisted->store(path);
+
+    suite.add("store/785;10,Sigmoid", [persisted, path]() {
+        persisted->store(path);
+    });
+
+    suite.add("load/785;10,Sigmoid", [persisted, path]() {
+        persisted->load(path);
+    });
+
+    std::string model = SCLT::ReadFromFile(path);
+    suite.add("pbag/model", [model]() {
+        SCLT::PBag::fromString(model, SCLT_PBAG_2_DELIMITER);
+    });
+
+    std::string checks = data.randomChecks(100, 3, 1);
+    suite.add("pbag/checks", [checks]() {
+        SCLT::PBag::fromString(checks, SCLT_PBAG_3_DELIMITER);
+    }, 100);
+
+    // a sparse update: only a few weights change between two persists
+    auto journaled = new SNN::Network;
+    journaled->loadShort("785;128,Sigmoid;10,Sigmoid");
+    std::string journalPath = "/tmp/snn-bench-" + std::to_string(getpid()) + "-journal.nn";
+    auto journal = new SNN::WeightJournal(journaled, journalPath);
+    journal->snapshot();
+    auto touch = [journaled]() {
+        static int next = 0;
+        auto& weights = journaled->parameters.weights;
+        for (int i = 0; i < 16; i++, next = (next + 7919) % weights.size()) weights[next] += 0.001;
+    };
+
+    suite.add("store/785;128,Sigmoid;10,Sigmoid", [journaled, journalPath, touch]() {
+        touch();
+        journaled->store(journalPath + ".store");
+    });
+
+    suite.add("journal-commit/785;128,Sigmoid;10,Sigmoid", [journal, touch]() {
+        touch();
+        journal->commit();
+    });
+
+    // train + publish against reading a pinned snapshot
+    auto served = new SNN::Network;
+    served->loadShort("785;128,Sigmoid;10,Sigmoid");
+    auto versions = new SNN::VersionedWeights(served);
+    auto readerWorkspace = new SNN::Workspace;
+    auto servedInput = data.randomVector(785);
+    auto servedExpected = data.randomVector(10);
+    versions->publish();
+
+    suite.add("train-publish/785;128,Sigmoid;10,Sigmoid", [served, versions, servedInput, servedExpected]() {
+        served->process(servedInput, servedExpected, SNN_DEFAULT_EPSILON);
+        versions->publish();
+    });
+
+    suite.add("forward-pinned/785;128,Sigmoid;10,Sigmoid", [versions, readerWorkspace, servedInput]() {
+        versions->pin()->process(readerWorkspace, servedInput);
+    });
+
+    // a repeated input answered from the result cache instead of a forward pass
+    auto cache = new SNN::ResultCache;
+    cache->setVersion(served->weightVersion);
+    cache->put(served->weightVersion, servedInput, SNN_DEFAULT_EPSILON, served->process(servedInput), "");
+    suite.add("cache-hit/785;128,Sigmoid;10,Sigmoid", [cache, served, servedInput]() {
+        SCLT::DoubleVector output;
+        std::string text;
+        cache->get(served->weightVersion, servedInput, SNN_DEFAULT_EPSILON, output, text);
+    });
+};
+
+// Every operation trains the same initial weights for a few epochs, so the
+// loss after the measurement compares how far both modes converge.
+static void AddConvergenceBenchmarks(SNN::BenchmarkSuite& suite, SNN::BenchmarkData& data)
+{
+    const int samples = 512;
+    const int epochs = 3;
+    std::string topology = "785;10,Softmax";
+
+    // sparse inputs labeled by a random teacher network
+    auto teacher = new SNN::Network;
+    teacher->seed = data.seed++;
+    teacher->loadShort(topology);
+    std::vector<SCLT::DoubleVector> inputs, expected;
+    for (int i = 0; i < samples; i++) {
+        auto input = data.randomVector(785);
+        for (int x = 0; x < input.size(); x++) {
+            if (SCLT::RandomUniform(data.seed, (uint64_t)i * 785 + x) < 0.8) input[x] = 0;
+        }
+        SCLT::DoubleVector output(10, 0);
+        output[SNN::ArgMax(teacher->process(input))] = 1;
+        inputs.push_back(input);
+        expected.push_back(output);
+    }
+    data.seed++;
+
+    auto synchronous = new SNN::Network;
+    synchronous->loadShort(topology);
+    synchronous->compile();
+    auto initial = synchronous->parameters.weights;
+
+    suite.add("converge-sync/" + topology, [synchronous, initial, inputs, expected, epochs]() {
+        synchronous->parameters.weights = initial;
+        for (int e = 0; e < epochs; e++) {
+            for (int i = 0; i < inputs.size(); i++) {
+                synchronous->process(inputs[i], expected[i], SNN_DEFAULT_EPSILON);
+            }
+        }
+    }, samples * epochs, [synchronous, inputs, expected]() {
+        return SNN::HogwildTrainer::MeanSquaredError(synchronous, inputs, expected);
+    });
+
+    auto asynchronous = new SNN::Network;
+    asynchronous->loadShort(topology);
+    asynchronous->compile();
+    auto trainer = new SNN::HogwildTrainer(asynchronous);
+
+    suite.add("converge-hogwild/" + topology, [asynchronous, trainer, initial, inputs, expected, epochs]() {
+        asynchronous->parameters.weights = initial;
+        for (int e = 0; e < epochs; e++) trainer->train(inputs, expected, SNN_DEFAULT_EPSILON);
+    }, samples * epochs, [asynchronous, inputs, expected]() {
+        return SNN::HogwildTrainer::MeanSquaredError(asynchronous, inputs, expected);
+    });
+};
+
+static void AddMnistBenchmarks(SNN::BenchmarkSuite& suite, SNN::BenchmarkData& data, int digits)
+{
+    auto mnist = new SNN::MNIST_Test;
+    std::mt19937 generator(data.seed++);
+
+    for (int i = 0; i < digits; i++) {
+        SNN::MNIST_Digit digit;
+        digit.label = generator() % 10;
+        for (int x = 0; x < 28; x++) {
+            for (int y = 0; y < 28; y++) {
+                digit.data[x][y] = generator() % 256;
+            }
+        }
+        mnist->digitsTrain.push_back(digit);
+    }
+
+    mnist->createNetwork();
+    // the results go to stdout as JSON
+    mnist->quiet = true;
+
+    suite.add("mnist/epoch", [mnist]() {
+        mnist->train(0.01);
+    }, digits);
+};
+
+static void AddServerBenchmarks(SNN::BenchmarkSuite& suite, SNN::BenchmarkData& data, int port)
+{
+    auto app = new SNN::CliApp;
+    app->network = new SNN::Network;
+    app->network->loadShort("3;10,Sigmoid;1");
+    char* argv[] = {(char*)"snn-bench", nullptr};
+    app->arguments = new SCLT::CliArguments(1, argv, {});
+
+    auto listener = new SNN::TcpListener;
+    listener->app = app;
+    auto server = new STS::TcpServer;
+    server->addRequestEventListener(listener);
+
+    std::thread([server, port]() {
+        try {
+            server->listen(port);
+        } catch (std::exception& e) {
+            std::cerr << "server: " << e.what() << std::endl;
+        }
+    }).detach();
+
+    // wait until the server accepts connections
+    for (int attempt = 0; ; attempt++) {
+        try {
+            SendRequest(port, "1,1,1");
+            break;
+        } catch (std::exception& e) {
+            if (attempt > 100) throw;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    std::string checks = data.randomChecks(10, 3, 0);
+    suite.add("server/request", [port, checks]() {
+        SendRequest(port, checks);
+    }, 10);
+};
+
+// one network per kernel kind, every hidden layer has to pass its error on
+static int RunGradientChecks(SNN::BenchmarkData& data)
+{
+    struct Case { std::string topology; double sparsity; bool skip; };
+    std::vector<Case> cases = {
+        {"4;6,Sigmoid;5,HTangent;3,Sigmoid", 0, false},
+        {"4;6,Sigmoid;5,HTangent;3,Softmax", 0, false},
+        {"8;16,Sigmoid;12,HTangent;4,Sigmoid", 0.9, false},
+        {"4;6,Sigmoid;5,HTangent;3,Sigmoid", 0, true},
+        {"1:6:6;Conv:2:3:1:1,Sigmoid,He;MaxPool:2;5,HTangent;3,Sigmoid", 0, false},
+        {"2:6:6;Conv:3:3:2:1,HTangent,He;AvgPool:2;3,Softmax", 0, false}
+    };
+
+    SNN::GradientCheck check;
+    int failed = 0;
+
+    for (const auto& entry : cases) {
+        SNN::Network network;
+        network.loadShort(entry.topology);
+        std::string name = entry.topology;
+
+        if (entry.sparsity > 0) {
+            SNN::Pruner pruner;
+            pruner.setSparsity(&network, entry.sparsity);
+            pruner.prune(&network);
+            name += " pruned";
+        }
+        if (entry.skip) {
+            // a synapse across a layer turns the network into a level schedule
+            network.addSynapse(network.getNeuron(0, 1), network.getNeuron(2, 2), 0.3);
+            network.invalidate();
+            name += " skip";
+        }
+
+        network.compile();
+        std::string kernels;
+        for (const auto& layer : network.engine->layers) {
+            if (layer.kernel != nullptr) kernels += (kernels.empty() ? "" : ",") + layer.kernel->getId();
+        }
+        if (kernels.empty()) kernels = "Schedule";
+
+        int inputs = network.neurons[0].size();
+        int outputs = network.neurons.back().size();
+        auto input = data.randomVector(inputs, -1, 1);
+        auto expected = data.randomVector(outputs);
+        if (network.engine->hasSoftmaxOutput()) {
+            double total = 0;
+            for (double value : expected) total += value;
+            for (double& value : expected) value /= total;
+        }
+
+        double error = check.check(&network, input, expected);
+        bool passed = error <= check.tolerance;
+        if (!passed) failed++;
+        std::cout << (passed ? "ok    " : "FAIL  ") << name << " (" << kernels << "): " << error << std::endl;
+    }
+
+    return failed == 0 ? 0 : EXIT_FAILURE;
+};
+
+int main(int argc, char **argv)
+{
+    SCLT::CliArguments* arguments;
+    arguments = new SCLT::CliArguments(argc, argv, {
+        {'o', "output", "write JSON results to file", true},
+        {'t', "time", "minimum seconds per benchmark", true},
+        {'b', "bench", "only run benchmarks containing this string", true},
+        {'d', "digits", "synthetic MNIST digits per epoch (default 1000)", true},
+        {'p', "port", "local port for server benchmarks", true},
+        {'g', "gradient-check", "compare backprop gradients with central differences instead, exit 1 on a mismatch"},
+        {'h', "help", "show this help"}
+    }, 25);
+
+    SNN::BenchmarkSuite suite;
+    SNN::BenchmarkData data;
+
+    if (arguments->has("time")) suite.minTime = std::stod(arguments->get("time"));
+    if (arguments->has("bench")) suite.filter = arguments->get("bench");
+
+    int digits = 1000;
+    if (arguments->has("digits")) digits = std::stoi(arguments->get("digits"));
+
+    if (arguments->has("gradient-check")) return RunGradientChecks(data);
+
+    int port = SNN_BENCH_DEFAULT_PORT;
+    if (arguments->has("port")) port = std::stoi(arguments->get("port"));
+
+    AddNetworkBenchmarks(suite, data);
+    AddConvergenceBenchmarks(suite, data);
+    AddMnistBenchmarks(suite, data, digits);
+    if (std::string("server/request").find(suite.filter) != std::string::npos) {
+        AddServerBenchmarks(suite, data, port);
+    }
+
+    std::string json = suite.toJson(suite.run());
+
+    if (arguments->has("output")) {
+        SCLT::WriteToFile(arguments->get("output"), json);
+    } else {
+        std::cout << json;
+    }
+
+    return 0;
+};
@@ -0,0 +1,150 @@
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "../header/cache.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    ResultCache::ResultCache(int capacity)
+    {
+        this->capacity = capacity;
+    };
+
+    uint64_t ResultCache::Hash(long version, const SCLT::DoubleVector& input, double epsilon)
+    {
+        uint64_t word;
+        std::memcpy(&word, &epsilon, sizeof(word));
+        uint64_t hash = word ^ input.size();
+
+        // a cheap multiplicative step per word, mixed properly once at the end
+        for (const auto& value : input) {
+            std::memcpy(&word, &value, sizeof(word));
+            hash = (((hash << 5) | (hash >> 59)) ^ word) * 0x9E3779B97F4A7C15ULL;
+        }
+        return SCLT::RandomHash(version, hash);
+    };
+
+    // readers may still hold an older snapshot after a publish, the version only
+    // moves forward, so they cannot swap it back and clear the cache again
+    bool ResultCache::setVersion(long version)
+    {
+        long current = this->version;
+        while (version > current) {
+            if (!this->version.compare_exchange_weak(current, version)) continue;
+            this->invalidations++;
+            this->clear();
+            return true;
+        }
+        return version == current;
+    };
+
+    bool ResultCache::get(
+        long version,
+        const SCLT::DoubleVector& input,
+        double epsilon,
+        SCLT::DoubleVector& output,
+        std::string& text
+    )
+    {
+        SPT_SCOPE("cache get");
+        uint64_t hash = Hash(version, input, epsilon);
+        auto& shard = this->shards[hash % SNN_CACHE_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto range = shard.index.equal_range(hash);
+        for (auto entry = range.first; entry != range.second; entry++) {
+            auto& result = *entry->second;
+            if (result.version != version || result.epsilon != epsilon || result.input != input) continue;
+
+            // move to the front
+            shard.entries.splice(shard.entries.begin(), shard.entries, entry->second);
+            output = result.output;
+            text = result.text;
+            this->hits++;
+            return true;
+        }
+
+        this->misses++;
+        return false;
+    };
+
+    void ResultCache::put(
+        long version,
+        const SCLT::DoubleVector& input,
+        double epsilon,
+        SCLT::DoubleVector output,
+        std::string text
+    )
+    {
+        // computed with weights that are gone already
+        if (version != this->version) return;
+
+        uint64_t hash = Hash(version, input, epsilon);
+        auto& shard = this->shards[hash % SNN_CACHE_SHARDS];
+        int shardCapacity = std::max(1, this->capacity / SNN_CACHE_SHARDS);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto range = shard.index.equal_range(hash);
+        for (auto entry = range.first; entry != range.second; entry++) {
+            auto& result = *entry->second;
+            if (result.version == version && result.epsilon == epsilon && result.input == input) return;
+        }
+
+        CachedResult result;
+        result.hash = hash;
+        result.version = version;
+        result.input = input;
+        result.epsilon = epsilon;
+        result.output = std::move(output);
+        result.text = std::move(text);
+        shard.entries.push_front(std::move(result));
+        shard.index.insert({hash, shard.entries.begin()});
+
+        while (shard.entries.size() > shardCapacity) {
+            auto last = std::prev(shard.entries.end());
+            auto range = shard.index.equal_range(last->hash);
+            for (auto entry = range.first; entry != range.second; entry++) {
+                if (entry->second == last) {
+                    shard.index.erase(entry);
+                    break;
+                }
+            }
+            shard.entries.erase(last);
+            this->evictions++;
+        }
+    };
+
+    void ResultCache::clear()
+    {
+        for (auto& shard : this->shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.entries.clear();
+            shard.index.clear();
+        }
+    };
+
+    int ResultCache::size()
+    {
+        int size = 0;
+        for (auto& shard : this->shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size += shard.entries.size();
+        }
+        return size;
+    };
+
+    std::string ResultCache::toString()
+    {
+        long hits = this->hits, misses = this->misses;
+        std::ostringstream out;
+        out << "cache: " << hits << " hits, " << misses << " misses ("
+            << std::fixed << std::setprecision(1)
+            << (hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0) << "% hit rate), "
+            << this->evictions << " evictions, " << this->invalidations << " invalidations, "
+            << this->size() << "/" << this->capacity << " entries";
+        return out.str();
+    };
+};
@@ -0,0 +1,1315 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <map>
+#include "../header/engine.hpp"
+#include "../header/optimizer.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    void LayerKernel::forwardRows(const double* weights, const double* input, double* sums, const int* rows, int count)
+    {
+        this->forward(weights, input, sums);
+    };
+
+    void LayerKernel::markInputs(int output, std::vector<char>& inputs)
+    {
+        std::fill(inputs.begin(), inputs.end(), 1);
+    };
+
+    void LayerKernel::markGradients(const double* input, const double* scaledDeltas, std::vector<std::pair<int, int>>& ranges)
+    {
+        if (this->size > 0) ranges.push_back({this->offset, this->offset + this->size});
+    };
+
+    // neighbouring ranges are merged, so a dense input hardly ever costs one range per row
+    static inline void AddRange(std::vector<std::pair<int, int>>& ranges, int first, int last)
+    {
+        if (!ranges.empty() && ranges.back().second == first) {
+            ranges.back().second = last;
+        } else {
+            ranges.push_back({first, last});
+        }
+    };
+
+    std::string LayerKernel::getShape()
+    {
+        return this->getId() + ":" + std::to_string(this->inputs) + "x" + std::to_string(this->outputs);
+    };
+
+    std::vector<std::pair<int, int>> LayerKernel::getBlockings()
+    {
+        return {};
+    };
+
+    std::string DenseKernel::getId()
+    {
+        return SNN_KERNEL_ID_DENSE;
+    };
+
+    std::vector<std::pair<int, int>> DenseKernel::getBlockings()
+    {
+        std::vector<std::pair<int, int>> blockings;
+        for (int unroll : {1, 2, 4}) {
+            blockings.push_back({0, unroll});
+            for (int tile = 64; tile < this->outputs; tile *= 2) blockings.push_back({tile, unroll});
+        }
+        return blockings;
+    };
+
+    // adds count rows to the outputs [first, last), one pass over the sums per row
+    // group; the additions per output stay in row order for every unroll
+    template<int Unroll>
+    static inline void DenseRows(
+        const double* weights,
+        int outputs,
+        const int* rows,
+        const double* values,
+        int count,
+        double* sums,
+        int first,
+        int last
+    )
+    {
+        double* __restrict s = sums;
+        int k = 0;
+
+        for (; k + Unroll <= count; k += Unroll) {
+            const double* __restrict r0 = weights + (long)rows[k] * outputs;
+            const double x0 = values[k];
+            if (Unroll == 1) {
+                for (int o = first; o < last; o++) s[o] += x0 * r0[o];
+                continue;
+            }
+
+            const double* __restrict r1 = weights + (long)rows[k + 1] * outputs;
+            const double x1 = values[k + 1];
+            if (Unroll == 2) {
+                for (int o = first; o < last; o++) s[o] = s[o] + x0 * r0[o] + x1 * r1[o];
+                continue;
+            }
+
+            const double* __restrict r2 = weights + (long)rows[k + 2] * outputs;
+            const double* __restrict r3 = weights + (long)rows[k + 3] * outputs;
+            const double x2 = values[k + 2], x3 = values[k + 3];
+            for (int o = first; o < last; o++) {
+                s[o] = s[o] + x0 * r0[o] + x1 * r1[o] + x2 * r2[o] + x3 * r3[o];
+            }
+        }
+
+        for (; k < count; k++) {
+            const double* __restrict row = weights + (long)rows[k] * outputs;
+            const double x = values[k];
+            for (int o = first; o < last; o++) s[o] += x * row[o];
+        }
+    };
+
+    void DenseKernel::forward(const double* weights, const double* input, double* sums)
+    {
+        const int outputs = this->outputs;
+        const int tile = this->tile > 0 ? this->tile : outputs;
+        std::fill(sums, sums + outputs, 0.0);
+
+        int rows[SNN_DENSE_SLICE];
+        double values[SNN_DENSE_SLICE];
+
+        for (int slice = 0; slice < this->inputs; slice += SNN_DENSE_SLICE) {
+            const int end = std::min(slice + SNN_DENSE_SLICE, this->inputs);
+            int count = 0;
+            for (int i = slice; i < end; i++) {
+                if (input[i] == 0) continue;
+                rows[count] = i;
+                values[count++] = input[i];
+            }
+            if (count == 0) continue;
+
+            for (int first = 0; first < outputs; first += tile) {
+                const int last = std::min(first + tile, outputs);
+                if (this->unroll >= 4) {
+                    DenseRows<4>(weights, outputs, rows, values, count, sums, first, last);
+                } else if (this->unroll == 2) {
+                    DenseRows<2>(weights, outputs, rows, values, count, sums, first, last);
+                } else {
+                    DenseRows<1>(weights, outputs, rows, values, count, sums, first, last);
+                }
+            }
+        }
+    };
+
+    void DenseKernel::forwardRows(const double* weights, const double* input, double* sums, const int* rows, int count)
+    {
+        const int outputs = this->outputs;
+
+        // same summation order as forward()
+        for (int r = 0; r < count; r++) {
+            const double* column = weights + rows[r];
+            double sum = 0;
+            for (int i = 0; i < this->inputs; i++) {
+                const double x = input[i];
+                if (x != 0) sum += x * column[(long)i * outputs];
+            }
+            sums[rows[r]] = sum;
+        }
+    };
+
+    void DenseKernel::backward(
+        const double* weights,
+        const double* input,
+        const double* scaledDeltas,
+        double* inputDeltas,
+        double* gradients
+    )
+    {
+        const int outputs = this->outputs;
+        const double* __restrict scaled = scaledDeltas;
+        const double* __restrict mask = this->mask.empty() ? nullptr : this->mask.data();
+
+        for (int i = 0; i < this->inputs; i++) {
+            const double* __restrict row = weights + (long)i * outputs;
+            double* __restrict gradientRow = gradients + (long)i * outputs;
+
+            if (inputDeltas != nullptr) {
+                double delta = 0;
+                for (int o = 0; o < outputs; o++) delta += scaled[o] * row[o];
+                inputDeltas[i] = delta;
+            }
+
+            const double x = input[i];
+            if (x == 0) continue;
+
+            if (mask == nullptr) {
+                for (int o = 0; o < outputs; o++) gradientRow[o] -= x * scaled[o];
+            } else {
+                const double* __restrict maskRow = mask + (long)i * outputs;
+                for (int o = 0; o < outputs; o++) gradientRow[o] -= x * scaled[o] * maskRow[o];
+            }
+        }
+    };
+
+    // backward() only writes the rows of non-zero inputs
+    void DenseKernel::markGradients(const double* input, const double* scaledDeltas, std::vector<std::pair<int, int>>& ranges)
+    {
+        for (int i = 0; i < this->inputs; i++) {
+            if (input[i] == 0) continue;
+            int first = this->offset + i * this->outputs;
+            AddRange(ranges, first, first + this->outputs);
+        }
+    };
+
+    std::string SparseKernel::getId()
+    {
+        return SNN_KERNEL_ID_SPARSE;
+    };
+
+    static inline double SparseRow(const SparseKernel* kernel, int o, const double* weights, const double* input)
+    {
+        const int* __restrict columns = kernel->columns.data();
+
+        // two accumulators keep the gather loads independent
+        double a = 0, b = 0;
+        int k = kernel->rowStart[o];
+        const int last = kernel->rowStart[o + 1];
+        for (; k + 1 < last; k += 2) {
+            a += weights[k] * input[columns[k]];
+            b += weights[k + 1] * input[columns[k + 1]];
+        }
+        if (k < last) a += weights[k] * input[columns[k]];
+        return a + b;
+    };
+
+    void SparseKernel::forward(const double* weights, const double* input, double* sums)
+    {
+        for (int o = 0; o < this->outputs; o++) sums[o] = SparseRow(this, o, weights, input);
+    };
+
+    void SparseKernel::forwardRows(const double* weights, const double* input, double* sums, const int* rows, int count)
+    {
+        for (int r = 0; r < count; r++) sums[rows[r]] = SparseRow(this, rows[r], weights, input);
+    };
+
+    void SparseKernel::markInputs(int output, std::vector<char>& inputs)
+    {
+        for (int k = this->rowStart[output]; k < this->rowStart[output + 1]; k++) inputs[this->columns[k]] = 1;
+    };
+
+    void SparseKernel::markGradients(const double* input, const double* scaledDeltas, std::vector<std::pair<int, int>>& ranges)
+    {
+        for (int o = 0; o < this->outputs; o++) {
+            if (scaledDeltas[o] == 0) continue;
+            AddRange(ranges, this->offset + this->rowStart[o], this->offset + this->rowStart[o + 1]);
+        }
+    };
+
+    void SparseKernel::backward(
+        const double* weights,
+        const double* input,
+        const double* scaledDeltas,
+        double* inputDeltas,
+        double* gradients
+    )
+    {
+        const int* __restrict columns = this->columns.data();
+
+        for (int o = 0; o < this->outputs; o++) {
+            const double scaled = scaledDeltas[o];
+            if (scaled == 0) continue;
+            for (int k = this->rowStart[o]; k < this->rowStart[o + 1]; k++) {
+                gradients[k] -= scaled * input[columns[k]];
+            }
+        }
+
+        if (inputDeltas == nullptr) return;
+
+        const int* __restrict rows = this->columnRows.data();
+        const int* __restrict positions = this->columnPositions.data();
+
+        for (int i = 0; i < this->inputs; i++) {
+            double delta = 0;
+            for (int p = this->columnStart[i]; p < this->columnStart[i + 1]; p++) {
+                delta += scaledDeltas[rows[p]] * weights[positions[p]];
+            }
+            inputDeltas[i] = delta;
+        }
+    };
+
+    std::string ConvolutionKernel::getId()
+    {
+        return SNN_KERNEL_ID_CONVOLUTION;
+    };
+
+    // positions [first, last) of one output row whose window column kx falls inside the input
+    static void InsideRange(LayerStructure& shape, int ox, int run, int kx, int& first, int& last)
+    {
+        int lowest = shape.padding - kx;
+        int highest = shape.inputWidth - 1 + shape.padding - kx;
+        first = lowest <= 0 ? 0 : (lowest + shape.stride - 1) / shape.stride;
+        last = highest < 0 ? 0 : highest / shape.stride + 1;
+        first = std::min(std::max(first - ox, 0), run);
+        last = std::min(std::max(last - ox, first), run);
+    };
+
+    void ConvolutionKernel::unfold(const double* input, double* columns, int first, int count)
+    {
+        auto& shape = this->structure;
+        const int stride = shape.stride;
+        int row = 0;
+
+        for (int c = 0; c < shape.inputChannels; c++) {
+            const double* channel = input + (long)c * shape.inputHeight * shape.inputWidth;
+            for (int ky = 0; ky < shape.kernel; ky++) {
+                for (int kx = 0; kx < shape.kernel; kx++, row++) {
+                    double* out = columns + (long)row * count;
+                    int oy = first / shape.width;
+                    int ox = first % shape.width;
+
+                    // one output row at a time, so the bounds checks leave the inner loop
+                    for (int j = 0; j < count; ox = 0, oy++) {
+                        int run = std::min(count - j, shape.width - ox);
+                        int y = oy * stride + ky - shape.padding;
+                        double* __restrict o = out + j;
+                        j += run;
+
+                        if (y < 0 || y >= shape.inputHeight) {
+                            std::fill(o, o + run, 0.0);
+                            continue;
+                        }
+
+                        int inside, outside;
+                        InsideRange(shape, ox, run, kx, inside, outside);
+                        const double* __restrict source = channel + y * shape.inputWidth
+                            + ox * stride + kx - shape.padding;
+                        std::fill(o, o + inside, 0.0);
+                        for (int t = inside; t < outside; t++) o[t] = source[t * stride];
+                        std::fill(o + outside, o + run, 0.0);
+                    }
+                }
+            }
+        }
+    };
+
+    void ConvolutionKernel::fold(const double* columns, double* inputDeltas, int first, int count)
+    {
+        auto& shape = this->structure;
+        const int stride = shape.stride;
+        int row = 0;
+
+        for (int c = 0; c < shape.inputChannels; c++) {
+            double* channel = inputDeltas + (long)c * shape.inputHeight * shape.inputWidth;
+            for (int ky = 0; ky < shape.kernel; ky++) {
+                for (int kx = 0; kx < shape.kernel; kx++, row++) {
+                    const double* in = columns + (long)row * count;
+                    int oy = first / shape.width;
+                    int ox = first % shape.width;
+
+                    for (int j = 0; j < count; ox = 0, oy++) {
+                        int run = std::min(count - j, shape.width - ox);
+                        int y = oy * stride + ky - shape.padding;
+                        const double* i = in + j;
+                        j += run;
+                        if (y < 0 || y >= shape.inputHeight) continue;
+
+                        int inside, outside;
+                        InsideRange(shape, ox, run, kx, inside, outside);
+                        double* target = channel + y * shape.inputWidth + ox * stride + kx - shape.padding;
+                        for (int t = inside; t < outside; t++) target[t * stride] += i[t];
+                    }
+                }
+            }
+        }
+    };
+
+    std::string ConvolutionKernel::getShape()
+    {
+        return LayerKernel::getShape() + "x" + std::to_string(this->structure.inputChannels * this->structure.getWindowSize());
+    };
+
+    std::vector<std::pair<int, int>> ConvolutionKernel::getBlockings()
+    {
+        std::vector<std::pair<int, int>> blockings = {{0, 1}};
+        const int positions = this->structure.height * this->structure.width;
+        for (int tile = 32; tile < positions && tile <= 4 * SNN_CONVOLUTION_BLOCK; tile *= 2) {
+            if (tile != SNN_CONVOLUTION_BLOCK) blockings.push_back({tile, 1});
+        }
+        return blockings;
+    };
+
+    int ConvolutionKernel::getBlock()
+    {
+        return this->tile > 0 ? this->tile : SNN_CONVOLUTION_BLOCK;
+    };
+
+    void ConvolutionKernel::forward(const double* weights, const double* input, double* sums)
+    {
+        const int window = this->structure.inputChannels * this->structure.getWindowSize();
+        const int positions = this->structure.height * this->structure.width;
+        const int block = this->getBlock();
+        // per thread scratch, kernels are shared by everyone running the engine
+        static thread_local SCLT::DoubleVector columns;
+        columns.resize((long)window * block);
+
+        for (int first = 0; first < positions; first += block) {
+            const int count = std::min(block, positions - first);
+            this->unfold(input, columns.data(), first, count);
+
+            for (int c = 0; c < this->structure.channels; c++) {
+                double* __restrict s = sums + (long)c * positions + first;
+                const double* filter = weights + (long)c * window;
+                std::fill(s, s + count, 0.0);
+
+                for (int k = 0; k < window; k++) {
+                    const double w = filter[k];
+                    if (w == 0) continue;
+                    const double* __restrict row = columns.data() + (long)k * count;
+                    for (int j = 0; j < count; j++) s[j] += w * row[j];
+                }
+            }
+        }
+    };
+
+    void ConvolutionKernel::backward(
+        const double* weights,
+        const double* input,
+        const double* scaledDeltas,
+        double* inputDeltas,
+        double* gradients
+    )
+    {
+        const int window = this->structure.inputChannels * this->structure.getWindowSize();
+        const int positions = this->structure.height * this->structure.width;
+        // gradients add up per block, so training keeps the default blocking
+        const int block = SNN_CONVOLUTION_BLOCK;
+        static thread_local SCLT::DoubleVector columns;
+        static thread_local SCLT::DoubleVector deltaColumns;
+        columns.resize((long)window * block);
+
+        if (inputDeltas != nullptr) {
+            std::fill(inputDeltas, inputDeltas + this->inputs, 0.0);
+            deltaColumns.resize((long)window * block);
+        }
+
+        for (int first = 0; first < positions; first += block) {
+            const int count = std::min(block, positions - first);
+            this->unfold(input, columns.data(), first, count);
+
+            for (int c = 0; c < this->structure.channels; c++) {
+                const double* __restrict scaled = scaledDeltas + (long)c * positions + first;
+                double* gradient = gradients + (long)c * window;
+
+                for (int k = 0; k < window; k++) {
+                    const double* __restrict row = columns.data() + (long)k * count;
+                    double sum = 0;
+                    for (int j = 0; j < count; j++) sum += scaled[j] * row[j];
+                    gradient[k] -= sum;
+                }
+            }
+
+            if (inputDeltas == nullptr) continue;
+
+            std::fill(deltaColumns.begin(), deltaColumns.begin() + (long)window * count, 0.0);
+            for (int c = 0; c < this->structure.channels; c++) {
+                const double* __restrict delta = scaledDeltas + (long)c * positions + first;
+                const double* filter = weights + (long)c * window;
+
+                for (int k = 0; k < window; k++) {
+                    const double w = filter[k];
+                    if (w == 0) continue;
+                    double* __restrict row = deltaColumns.data() + (long)k * count;
+                    for (int j = 0; j < count; j++) row[j] += w * delta[j];
+                }
+            }
+
+            this->fold(deltaColumns.data(), inputDeltas, first, count);
+        }
+    };
+
+    std::string PoolingKernel::getId()
+    {
+        return SNN_KERNEL_ID_POOLING;
+    };
+
+    int PoolingKernel::findMaximum(const double* input, int output)
+    {
+        auto& shape = this->structure;
+        int positions = shape.height * shape.width;
+        int c = output / positions;
+        int y = (output % positions) / shape.width * shape.stride;
+        int x = output % shape.width * shape.stride;
+
+        int best = (c * shape.inputHeight + y) * shape.inputWidth + x;
+        for (int ky = 0; ky < shape.kernel; ky++) {
+            for (int kx = 0; kx < shape.kernel; kx++) {
+                int i = (c * shape.inputHeight + y + ky) * shape.inputWidth + x + kx;
+                if (input[i] > input[best]) best = i;
+            }
+        }
+        return best;
+    };
+
+    void PoolingKernel::forward(const double* weights, const double* input, double* sums)
+    {
+        auto& shape = this->structure;
+
+        if (shape.type == SNN_LAYER_ID_MAX_POOL) {
+            for (int o = 0; o < this->outputs; o++) sums[o] = input[this->findMaximum(input, o)];
+            return;
+        }
+
+        const double scale = 1.0 / shape.getWindowSize();
+        int o = 0;
+        for (int c = 0; c < shape.channels; c++) {
+            for (int oy = 0; oy < shape.height; oy++) {
+                for (int ox = 0; ox < shape.width; ox++, o++) {
+                    double sum = 0;
+                    for (int ky = 0; ky < shape.kernel; ky++) {
+                        const double* row = input
+                            + (c * shape.inputHeight + oy * shape.stride + ky) * shape.inputWidth
+                            + ox * shape.stride;
+                        for (int kx = 0; kx < shape.kernel; kx++) sum += row[kx];
+                    }
+                    sums[o] = sum * scale;
+                }
+            }
+        }
+    };
+
+    void PoolingKernel::backward(
+        const double* weights,
+        const double* input,
+        const double* scaledDeltas,
+        double* inputDeltas,
+        double* gradients
+    )
+    {
+        if (inputDeltas == nullptr) return;
+        auto& shape = this->structure;
+        std::fill(inputDeltas, inputDeltas + this->inputs, 0.0);
+
+        if (shape.type == SNN_LAYER_ID_MAX_POOL) {
+            for (int o = 0; o < this->outputs; o++) inputDeltas[this->findMaximum(input, o)] += scaledDeltas[o];
+            return;
+        }
+
+        const double scale = 1.0 / shape.getWindowSize();
+        int o = 0;
+        for (int c = 0; c < shape.channels; c++) {
+            for (int oy = 0; oy < shape.height; oy++) {
+                for (int ox = 0; ox < shape.width; ox++, o++) {
+                    for (int ky = 0; ky < shape.kernel; ky++) {
+                        double* row = inputDeltas
+                            + (c * shape.inputHeight + oy * shape.stride + ky) * shape.inputWidth
+                            + ox * shape.stride;
+                        for (int kx = 0; kx < shape.kernel; kx++) row[kx] += scaledDeltas[o] * scale;
+                    }
+                }
+            }
+        }
+    };
+
+    int EngineLayer::size()
+    {
+        return this->activationFunctions.size();
+    };
+
+    int LevelSchedule::size()
+    {
+        return this->activationFunctions.size();
+    };
+
+    // runs body over the slots of a level, split across the thread pool when
+    // the level has enough synapses to pay for the hand-off
+    template<typename Body>
+    static void ForEachInLevel(LevelSchedule* schedule, int level, Body body)
+    {
+        int first = schedule->levelStart[level];
+        int last = schedule->levelStart[level + 1];
+        long work = schedule->rowStart[last] - schedule->rowStart[first]
+            + schedule->outputStart[last] - schedule->outputStart[first];
+
+        auto pool = SCLT::ThreadPool::shared();
+        if (work < SNN_PARALLEL_LEVEL_WORK || last - first < 2 || pool->size() < 2) {
+            body(first, last);
+            return;
+        }
+
+        int chunk = std::max(1L, (long)(last - first) * SNN_PARALLEL_LEVEL_WORK / 4 / work);
+        pool->parallelFor(first, last, body, chunk);
+    };
+
+    inline void LevelSchedule::forwardSlot(
+        int s,
+        const double* weights,
+        Workspace* workspace,
+        const SCLT::DoubleVector& input
+    )
+    {
+        double* values = workspace->values[0].data();
+        const int* __restrict columns = this->columns.data();
+
+        if (this->rowStart[s] == this->rowStart[s + 1]) {
+            // neurons without inputs: the inputs of layer 0, zero everywhere else
+            int index = this->inputIndex[s];
+            values[s] = index >= 0 && index < input.size() ? input[index] : 0;
+            return;
+        }
+
+        double sum = 0;
+        for (int k = this->rowStart[s]; k < this->rowStart[s + 1]; k++) {
+            sum += weights[k] * values[columns[k]];
+        }
+        workspace->sums[0][s] = sum;
+
+        auto activationFunction = this->activationFunctions[s];
+        values[s] = activationFunction == nullptr ? sum : activationFunction->activate(sum);
+    };
+
+    void LevelSchedule::forward(const double* weights, Workspace* workspace, const SCLT::DoubleVector& input)
+    {
+        for (int level = 0; level + 1 < this->levelStart.size(); level++) {
+            SPT_SCOPE_ARG("forward level", level);
+
+            ForEachInLevel(this, level, [this, weights, workspace, &input](int from, int to) {
+                for (int s = from; s < to; s++) this->forwardSlot(s, weights, workspace, input);
+            });
+        }
+
+        this->normalize(workspace);
+    };
+
+    void LevelSchedule::normalize(Workspace* workspace)
+    {
+        if (!this->softmax) return;
+
+        double* values = workspace->values[0].data();
+        SCLT::DoubleVector output(this->outputSlots.size());
+        for (int i = 0; i < output.size(); i++) output[i] = values[this->outputSlots[i]];
+        Softmax::normalize(output.data(), output.data(), output.size());
+        for (int i = 0; i < output.size(); i++) values[this->outputSlots[i]] = output[i];
+    };
+
+    void LevelSchedule::backward(
+        const double* weights,
+        double* gradients,
+        Workspace* workspace,
+        const SCLT::DoubleVector& expectedOutput
+    )
+    {
+        const double* sums = workspace->sums[0].data();
+        double* values = workspace->values[0].data();
+        double* deltas = workspace->deltas[0].data();
+        double* scaledDeltas = workspace->scaledDeltas[0].data();
+        const int* __restrict columns = this->columns.data();
+
+        // reverse schedule: every neuron a delta is gathered from sits in a later level
+        for (int level = this->levelStart.size() - 2; level >= 0; level--) {
+            SPT_SCOPE_ARG("backprop level", level);
+
+            ForEachInLevel(this, level, [&](int from, int to) {
+                for (int s = from; s < to; s++) {
+                    if (this->rowStart[s] == this->rowStart[s + 1]) {
+                        deltas[s] = scaledDeltas[s] = 0;
+                        continue;
+                    }
+
+                    // neurons without outputs compare against the expected output, the
+                    // others gather the already scaled deltas of the neurons they feed
+                    double delta = 0;
+                    if (this->outputStart[s] == this->outputStart[s + 1]) {
+                        int index = this->expectedIndex[s];
+                        double expected = index < expectedOutput.size() ? expectedOutput[index] : 0;
+                        delta = expected - values[s];
+                    } else {
+                        for (int p = this->outputStart[s]; p < this->outputStart[s + 1]; p++) {
+                            delta += scaledDeltas[this->outputRows[p]] * weights[this->outputPositions[p]];
+                        }
+                    }
+
+                    double factor = 1;
+                    if (this->activationFunctions[s] != nullptr) {
+                        factor = this->activationFunctions[s]->derivative(sums[s], values[s]);
+                    }
+                    deltas[s] = delta;
+                    scaledDeltas[s] = factor * delta;
+
+                    for (int k = this->rowStart[s]; k < this->rowStart[s + 1]; k++) {
+                        gradients[k] -= scaledDeltas[s] * values[columns[k]];
+                    }
+                }
+            });
+        }
+    };
+
+    void LevelSchedule::markGradients(Workspace* workspace, std::vector<std::pair<int, int>>& ranges)
+    {
+        const double* scaledDeltas = workspace->scaledDeltas[0].data();
+        for (int s = 0; s + 1 < this->rowStart.size(); s++) {
+            if (scaledDeltas[s] == 0 || this->rowStart[s] == this->rowStart[s + 1]) continue;
+            AddRange(ranges, this->rowStart[s], this->rowStart[s + 1]);
+        }
+    };
+
+    Engine::~Engine()
+    {
+        for (auto& layer : this->layers) delete layer.kernel;
+        for (auto& entry : this->cones) delete entry.second;
+        delete this->schedule;
+    };
+
+    bool Engine::isLayered()
+    {
+        return this->schedule == nullptr;
+    };
+
+    void Engine::compile(Network* network)
+    {
+        if (this->compileLayers(network)) return;
+
+        for (int l = 0; l < network->neurons.size(); l++) {
+            if (network->isStructured(l)) {
+                throw std::invalid_argument("convolution and pooling layers need a strictly layered network");
+            }
+        }
+
+        this->compileSchedule(network);
+    };
+
+    void Engine::compileSchedule(Network* network)
+    {
+        std::vector<Neuron*> neurons;
+        std::map<Neuron*, int> numbers;
+        for (const auto& neuronLayer : network->neurons) {
+            for (const auto& neuron : neuronLayer) {
+                numbers[neuron] = neurons.size();
+                neurons.push_back(neuron);
+            }
+        }
+
+        // Kahn's algorithm, one level at a time; a neuron's level is one more than
+        // the highest level among its inputs
+        std::vector<int> pending(neurons.size());
+        std::vector<int> current;
+        for (int n = 0; n < neurons.size(); n++) {
+            pending[n] = neurons[n]->inputSynapses.size();
+            if (pending[n] == 0) current.push_back(n);
+        }
+
+        std::vector<int> order;
+        auto schedule = new LevelSchedule;
+        schedule->levelStart.push_back(0);
+
+        while (!current.empty()) {
+            order.insert(order.end(), current.begin(), current.end());
+            schedule->levelStart.push_back(order.size());
+
+            std::vector<int> next;
+            for (const auto& n : current) {
+                for (const auto& synapse : neurons[n]->outputSynapses) {
+                    int target = numbers[synapse->outputNeuron];
+                    if (--pending[target] == 0) next.push_back(target);
+                }
+            }
+
+            // network order (layer, index) within a level keeps the plan deterministic
+            std::sort(next.begin(), next.end());
+            current.swap(next);
+        }
+
+        if (order.size() < neurons.size()) {
+            delete schedule;
+            throw std::invalid_argument("the network has a cycle");
+        }
+
+        std::vector<int> slots(neurons.size());
+        for (int s = 0; s < order.size(); s++) slots[order[s]] = s;
+
+        std::vector<int> source;
+        std::vector<std::pair<Synapse*, int>> placements;
+        schedule->rowStart.push_back(0);
+        schedule->outputStart.resize(order.size() + 1, 0);
+
+        for (int s = 0; s < order.size(); s++) {
+            auto neuron = neurons[order[s]];
+            schedule->activationFunctions.push_back(neuron->activationFunction);
+            schedule->inputIndex.push_back(neuron->layer == 0 ? neuron->index : -1);
+            schedule->expectedIndex.push_back(neuron->index);
+
+            auto row = neuron->inputSynapses;
+            std::stable_sort(row.begin(), row.end(), [&slots, &numbers](Synapse* a, Synapse* b) {
+                return slots[numbers[a->inputNeuron]] < slots[numbers[b->inputNeuron]];
+            });
+            for (const auto& synapse : row) {
+                int input = slots[numbers[synapse->inputNeuron]];
+                schedule->columns.push_back(input);
+                schedule->outputStart[input + 1]++;
+                placements.push_back({synapse, (int)source.size()});
+                source.push_back(synapse->index);
+            }
+            schedule->rowStart.push_back(schedule->columns.size());
+        }
+
+        for (int s = 0; s < order.size(); s++) {
+            schedule->outputStart[s + 1] += schedule->outputStart[s];
+        }
+
+        std::vector<int> fill(schedule->outputStart.begin(), schedule->outputStart.end() - 1);
+        schedule->outputRows.resize(schedule->columns.size());
+        schedule->outputPositions.resize(schedule->columns.size());
+        for (int s = 0; s < order.size(); s++) {
+            for (int k = schedule->rowStart[s]; k < schedule->rowStart[s + 1]; k++) {
+                int p = fill[schedule->columns[k]]++;
+                schedule->outputRows[p] = s;
+                schedule->outputPositions[p] = k;
+            }
+        }
+
+        if (!network->neurons.empty()) {
+            std::vector<ActivationFunction*> outputFunctions;
+            for (const auto& neuron : network->neurons.back()) {
+                schedule->outputSlots.push_back(slots[numbers[neuron]]);
+                outputFunctions.push_back(neuron->activationFunction);
+            }
+            schedule->softmax = Softmax::isLayer(outputFunctions);
+        }
+
+        network->parameters.remap(source);
+        network->optimizer->remap(source);
+        for (const auto& placement : placements) {
+            placement.first->index = placement.second;
+        }
+
+        this->schedule = schedule;
+    };
+
+    bool Engine::compileLayers(Network* network)
+    {
+        auto& neurons = network->neurons;
+
+        for (int l = 0; l < neurons.size(); l++) {
+            for (const auto& neuron : neurons[l]) {
+                for (const auto& synapse : neuron->inputSynapses) {
+                    if (synapse->inputNeuron->layer != l - 1) return false;
+                }
+            }
+        }
+
+        // source[new parameter index] = old parameter index, -1 for padding
+        std::vector<int> source;
+        std::vector<std::pair<Synapse*, int>> placements;
+
+        this->layers.resize(neurons.size());
+
+        for (int l = 0; l < neurons.size(); l++) {
+            auto& layer = this->layers[l];
+            bool structured = network->isStructured(l);
+            bool feedsStructured = network->isStructured(l + 1);
+            for (const auto& neuron : neurons[l]) {
+                layer.activationFunctions.push_back(neuron->activationFunction);
+                layer.hasInputs.push_back(structured || !neuron->isInput());
+                layer.hasOutputs.push_back(feedsStructured || !neuron->isOutput());
+            }
+
+            if (l == 0) continue;
+            layer.softmax = Softmax::isLayer(layer.activationFunctions);
+
+            int inputs = neurons[l - 1].size();
+            int outputs = neurons[l].size();
+
+            if (structured) {
+                auto& structure = network->structures[l];
+                if (structure.getInputCount() != inputs || structure.getNeuronCount() != outputs) {
+                    throw std::invalid_argument("layer " + std::to_string(l) + " does not match its " + structure.type + " structure");
+                }
+
+                if (structure.type == SNN_LAYER_ID_CONVOLUTION) {
+                    auto kernel = new ConvolutionKernel;
+                    kernel->structure = structure;
+                    layer.kernel = kernel;
+                } else {
+                    auto kernel = new PoolingKernel;
+                    kernel->structure = structure;
+                    layer.kernel = kernel;
+                }
+
+                layer.kernel->offset = source.size();
+                for (int i = 0; i < structure.size; i++) source.push_back(structure.offset + i);
+                structure.offset = layer.kernel->offset;
+                layer.kernel->inputs = inputs;
+                layer.kernel->outputs = outputs;
+                layer.kernel->size = structure.size;
+                continue;
+            }
+            long possible = (long)inputs * outputs;
+            long synapses = 0;
+            for (const auto& neuron : neurons[l]) synapses += neuron->inputSynapses.size();
+
+            // dense needs exactly one slot per synapse, duplicates force CSR
+            std::vector<Synapse*> slots;
+            bool dense = possible > 0
+                && synapses <= possible
+                && synapses >= this->sparseThreshold * possible;
+
+            if (dense) {
+                slots.resize(possible, nullptr);
+                for (const auto& neuron : neurons[l]) {
+                    for (const auto& synapse : neuron->inputSynapses) {
+                        long slot = (long)synapse->inputNeuron->index * outputs + neuron->index;
+                        if (slots[slot] != nullptr) dense = false;
+                        slots[slot] = synapse;
+                    }
+                }
+            }
+
+            if (dense) {
+                auto kernel = new DenseKernel;
+                kernel->offset = source.size();
+                if (synapses < possible) kernel->mask.resize(possible, 0);
+
+                for (long slot = 0; slot < possible; slot++) {
+                    if (slots[slot] == nullptr) {
+                        source.push_back(-1);
+                        continue;
+                    }
+                    if (synapses < possible) kernel->mask[slot] = 1;
+                    placements.push_back({slots[slot], (int)source.size()});
+                    source.push_back(slots[slot]->index);
+                }
+
+                layer.kernel = kernel;
+
+            } else {
+                auto kernel = new SparseKernel;
+                kernel->offset = source.size();
+                kernel->rowStart.push_back(0);
+                kernel->columnStart.resize(inputs + 1, 0);
+
+                for (const auto& neuron : neurons[l]) {
+                    auto row = neuron->inputSynapses;
+                    std::stable_sort(row.begin(), row.end(), [](Synapse* a, Synapse* b) {
+                        return a->inputNeuron->index < b->inputNeuron->index;
+                    });
+                    for (const auto& synapse : row) {
+                        kernel->columns.push_back(synapse->inputNeuron->index);
+                        kernel->columnStart[synapse->inputNeuron->index + 1]++;
+                        placements.push_back({synapse, (int)source.size()});
+                        source.push_back(synapse->index);
+                    }
+                    kernel->rowStart.push_back(kernel->columns.size());
+                }
+
+                for (int i = 0; i < inputs; i++) {
+                    kernel->columnStart[i + 1] += kernel->columnStart[i];
+                }
+
+                std::vector<int> fill(kernel->columnStart.begin(), kernel->columnStart.end() - 1);
+                kernel->columnRows.resize(kernel->columns.size());
+                kernel->columnPositions.resize(kernel->columns.size());
+                for (int o = 0; o < outputs; o++) {
+                    for (int k = kernel->rowStart[o]; k < kernel->rowStart[o + 1]; k++) {
+                        int p = fill[kernel->columns[k]]++;
+                        kernel->columnRows[p] = o;
+                        kernel->columnPositions[p] = k;
+                    }
+                }
+
+                layer.kernel = kernel;
+            }
+
+            layer.kernel->inputs = inputs;
+            layer.kernel->outputs = outputs;
+            layer.kernel->size = source.size() - layer.kernel->offset;
+        }
+
+        network->parameters.remap(source);
+        network->optimizer->remap(source);
+        for (const auto& placement : placements) {
+            placement.first->index = placement.second;
+        }
+
+        return true;
+    };
+
+    SCLT::DoubleVector Engine::getOutput(Workspace* workspace, const OutputCone* cone)
+    {
+        if (cone != nullptr) {
+            SCLT::DoubleVector output(cone->outputs.size());
+            for (int i = 0; i < output.size(); i++) {
+                int o = cone->outputs[i];
+                output[i] = this->isLayered()
+                    ? workspace->values.back()[o]
+                    : workspace->values[0][this->schedule->outputSlots[o]];
+            }
+            return output;
+        }
+
+        if (this->isLayered()) {
+            return this->layers.empty() ? SCLT::DoubleVector() : workspace->values.back();
+        }
+
+        auto& slots = this->schedule->outputSlots;
+        SCLT::DoubleVector output(slots.size());
+        for (int i = 0; i < slots.size(); i++) output[i] = workspace->values[0][slots[i]];
+        return output;
+    };
+
+    const OutputCone* Engine::getCone(const std::vector<int>& outputs)
+    {
+        std::lock_guard<std::mutex> lock(this->coneMutex);
+        auto& cone = this->cones[outputs];
+        if (cone == nullptr) cone = this->compileCone(outputs);
+        return cone;
+    };
+
+    OutputCone* Engine::compileCone(const std::vector<int>& outputs)
+    {
+        SPT_SCOPE("compile cone");
+        int outputCount = this->isLayered()
+            ? (this->layers.empty() ? 0 : this->layers.back().size())
+            : this->schedule->outputSlots.size();
+
+        for (const auto& output : outputs) {
+            if (output < 0 || output >= outputCount) {
+                throw std::invalid_argument("no output " + std::to_string(output));
+            }
+        }
+
+        auto cone = new OutputCone;
+        cone->outputs = outputs;
+
+        if (!this->isLayered()) {
+            auto schedule = this->schedule;
+            std::vector<char> needed(schedule->size(), 0);
+            // softmax normalizes over every output
+            for (int o = 0; o < outputCount; o++) {
+                if (schedule->softmax) needed[schedule->outputSlots[o]] = 1;
+            }
+            for (const auto& output : outputs) needed[schedule->outputSlots[output]] = 1;
+
+            // inputs always come before a slot, so one pass backwards finds the whole cone
+            for (int s = needed.size() - 1; s >= 0; s--) {
+                if (!needed[s]) continue;
+                for (int k = schedule->rowStart[s]; k < schedule->rowStart[s + 1]; k++) {
+                    needed[schedule->columns[k]] = 1;
+                }
+            }
+
+            for (int s = 0; s < needed.size(); s++) {
+                if (needed[s]) cone->slots.push_back(s);
+            }
+            return cone;
+        }
+
+        int count = this->layers.size();
+        cone->rows.resize(count);
+        cone->complete.resize(count, 0);
+        if (count == 0) return cone;
+
+        std::vector<char> needed(this->layers.back().size(), 0);
+        for (const auto& output : outputs) needed[output] = 1;
+        if (this->layers.back().softmax) std::fill(needed.begin(), needed.end(), 1);
+
+        for (int l = count - 1; l >= 0; l--) {
+            for (int o = 0; o < needed.size(); o++) {
+                if (needed[o]) cone->rows[l].push_back(o);
+            }
+            cone->complete[l] = cone->rows[l].size() == needed.size();
+            if (l == 0) break;
+
+            std::vector<char> inputs(this->layers[l - 1].size(), 0);
+            for (const auto& o : cone->rows[l]) this->layers[l].kernel->markInputs(o, inputs);
+            needed.swap(inputs);
+        }
+
+        return cone;
+    };
+
+    void Engine::prepare(Workspace* workspace)
+    {
+        if (!this->isLayered()) {
+            // one buffer indexed by slot
+            int size = this->schedule->size();
+            for (auto buffer : {&workspace->sums, &workspace->values, &workspace->deltas, &workspace->scaledDeltas}) {
+                buffer->resize(1);
+                (*buffer)[0].resize(size, 0);
+            }
+            return;
+        }
+
+        int count = this->layers.size();
+        workspace->sums.resize(count);
+        workspace->values.resize(count);
+        workspace->deltas.resize(count);
+        workspace->scaledDeltas.resize(count);
+
+        for (int l = 0; l < count; l++) {
+            int size = this->layers[l].size();
+            workspace->sums[l].resize(size, 0);
+            workspace->values[l].resize(size, 0);
+            workspace->deltas[l].resize(size, 0);
+            workspace->scaledDeltas[l].resize(size, 0);
+        }
+    };
+
+    std::vector<int> Engine::getBlockOffsets(int parameterCount)
+    {
+        std::vector<int> offsets = {0};
+        if (this->isLayered()) {
+            for (int l = 1; l < this->layers.size(); l++) offsets.push_back(this->layers[l].kernel->offset);
+        }
+        offsets.push_back(parameterCount);
+        return offsets;
+    };
+
+    // weightsOf(l, kernel) returns the first weight of the kernel of layer l,
+    // without a cone every neuron is computed
+    template<typename WeightsOf>
+    static void ForwardLayers(
+        std::vector<EngineLayer>& layers,
+        WeightsOf weightsOf,
+        Workspace* workspace,
+        const SCLT::DoubleVector& input,
+        const OutputCone* cone = nullptr
+    )
+    {
+        auto& inputValues = workspace->values[0];
+        for (int i = 0; i < inputValues.size(); i++) {
+            inputValues[i] = i < input.size() ? input[i] : 0;
+        }
+
+        for (int l = 1; l < layers.size(); l++) {
+            SPT_SCOPE_ARG("forward", l);
+            auto& layer = layers[l];
+            double* sums = workspace->sums[l].data();
+            double* values = workspace->values[l].data();
+            const std::vector<int>* rows = cone == nullptr || cone->complete[l] ? nullptr : &cone->rows[l];
+            if (rows != nullptr && rows->empty()) continue;
+
+            if (rows == nullptr) {
+                layer.kernel->forward(weightsOf(l, layer.kernel), workspace->values[l - 1].data(), sums);
+            } else {
+                layer.kernel->forwardRows(
+                    weightsOf(l, layer.kernel),
+                    workspace->values[l - 1].data(),
+                    sums,
+                    rows->data(),
+                    rows->size()
+                );
+            }
+
+            SPT_SCOPE_ARG("activate", l);
+            // a cone always contains a softmax layer completely
+            if (layer.softmax) {
+                Softmax::normalize(sums, values, layer.size());
+                continue;
+            }
+
+            int count = rows == nullptr ? layer.size() : rows->size();
+            for (int r = 0; r < count; r++) {
+                int o = rows == nullptr ? r : (*rows)[r];
+                auto activationFunction = layer.activationFunctions[o];
+                if (!layer.hasInputs[o]) {
+                    values[o] = 0;
+                } else if (activationFunction == nullptr) {
+                    values[o] = sums[o];
+                } else {
+                    values[o] = activationFunction->activate(sums[o]);
+                }
+            }
+        }
+    };
+
+    void Engine::forward(const double* weights, Workspace* workspace, const SCLT::DoubleVector& input)
+    {
+        this->prepare(workspace);
+
+        if (!this->isLayered()) {
+            this->schedule->forward(weights, workspace, input);
+            return;
+        }
+
+        if (this->layers.empty()) return;
+        ForwardLayers(this->layers, [weights](int l, LayerKernel* kernel) {
+            return weights + kernel->offset;
+        }, workspace, input);
+    };
+
+    void Engine::forward(
+        const OutputCone* cone,
+        const double* weights,
+        Workspace* workspace,
+        const SCLT::DoubleVector& input
+    )
+    {
+        this->prepare(workspace);
+
+        if (!this->isLayered()) {
+            for (const auto& s : cone->slots) this->schedule->forwardSlot(s, weights, workspace, input);
+            this->schedule->normalize(workspace);
+            return;
+        }
+
+        if (this->layers.empty()) return;
+        ForwardLayers(this->layers, [weights](int l, LayerKernel* kernel) {
+            return weights + kernel->offset;
+        }, workspace, input, cone);
+    };
+
+    void Engine::forward(const double* const* blocks, Workspace* workspace, const SCLT::DoubleVector& input)
+    {
+        this->prepare(workspace);
+
+        if (!this->isLayered()) {
+            this->schedule->forward(blocks[0], workspace, input);
+            return;
+        }
+
+        if (this->layers.empty()) return;
+        ForwardLayers(this->layers, [blocks](int l, LayerKernel* kernel) {
+            return blocks[l];
+        }, workspace, input);
+    };
+
+    void Engine::backward(
+        const double* weights,
+        double* gradients,
+        Workspace* workspace,
+        const SCLT::DoubleVector& expectedOutput
+    )
+    {
+        if (!this->isLayered()) {
+            this->schedule->backward(weights, gradients, workspace, expectedOutput);
+            return;
+        }
+
+        for (int l = this->layers.size() - 1; l > 0; l--) {
+            SPT_SCOPE_ARG("backprop", l);
+            auto& layer = this->layers[l];
+            const double* sums = workspace->sums[l].data();
+            double* values = workspace->values[l].data();
+            double* deltas = workspace->deltas[l].data();
+            double* scaledDeltas = workspace->scaledDeltas[l].data();
+
+            if (layer.softmax) {
+                // cross-entropy through softmax: the gradient of the sums is expected - value
+                for (int o = 0; o < layer.size(); o++) {
+                    double expected = o < expectedOutput.size() ? expectedOutput[o] : 0;
+                    deltas[o] = scaledDeltas[o] = expected - values[o];
+                }
+            }
+
+            // neurons without outputs compare against the expected output, the
+            // others received their delta from layer l+1
+            for (int o = 0; !layer.softmax && o < layer.size(); o++) {
+                if (!layer.hasInputs[o]) {
+                    deltas[o] = 0;
+                } else if (!layer.hasOutputs[o]) {
+                    double expected = o < expectedOutput.size() ? expectedOutput[o] : 0;
+                    deltas[o] = expected - values[o];
+                }
+
+                double factor = 1;
+                if (layer.activationFunctions[o] != nullptr) {
+                    factor = layer.activationFunctions[o]->derivative(sums[o], values[o]);
+                }
+                scaledDeltas[o] = factor * deltas[o];
+            }
+
+            layer.kernel->backward(
+                weights + layer.kernel->offset,
+                workspace->values[l - 1].data(),
+                scaledDeltas,
+                l > 1 ? workspace->deltas[l - 1].data() : nullptr,
+                gradients + layer.kernel->offset
+            );
+        }
+    };
+
+    void Engine::markGradients(Workspace* workspace, std::vector<std::pair<int, int>>& ranges)
+    {
+        if (!this->isLayered()) {
+            this->schedule->markGradients(workspace, ranges);
+            return;
+        }
+
+        for (int l = 1; l < this->layers.size(); l++) {
+            this->layers[l].kernel->markGradients(
+                workspace->values[l - 1].data(),
+                workspace->scaledDeltas[l].data(),
+                ranges
+            );
+        }
+    };
+
+    bool Engine::hasSoftmaxOutput()
+    {
+        if (!this->isLayered()) return this->schedule->softmax;
+        return !this->layers.empty() && this->layers.back().softmax;
+    };
+
+    std::string Engine::getLossId()
+    {
+        return this->hasSoftmaxOutput() ? SNN_LOSS_ID_CROSS_ENTROPY : SNN_LOSS_ID_MEAN_SQUARED_ERROR;
+    };
+
+    double Engine::getLoss(Workspace* workspace, const SCLT::DoubleVector& expectedOutput)
+    {
+        const bool layered = this->isLayered();
+        const auto& values = layered ? workspace->values.back() : workspace->values[0];
+        int outputs = layered ? values.size() : this->schedule->outputSlots.size();
+        bool crossEntropy = this->hasSoftmaxOutput();
+
+        double loss = 0;
+        int count = 0;
+        for (int o = 0; o < outputs && o < expectedOutput.size(); o++) {
+            double value = values[layered ? o : this->schedule->outputSlots[o]];
+            if (crossEntropy) {
+                // a confidently wrong output costs a lot, but never infinity
+                if (expectedOutput[o] != 0) loss -= expectedOutput[o] * std::log(std::max(value, 1e-12));
+            } else {
+                loss += (expectedOutput[o] - value) * (expectedOutput[o] - value);
+            }
+            count++;
+        }
+
+        return crossEntropy || count == 0 ? loss : loss / count;
+    };
+};
@@ -0,0 +1,159 @@
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include <stdexcept>
+#include "../header/export.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    std::string HeaderExporter::FormatWeight(double weight)
+    {
+        // 17 significant digits read back as the same double
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.17g", weight);
+        return buffer;
+    };
+
+    std::string HeaderExporter::ToIdentifier(std::string name)
+    {
+        for (auto& c : name) {
+            if (!std::isalnum((unsigned char)c)) c = '_';
+        }
+        if (name.empty() || std::isdigit((unsigned char)name[0])) name = "_" + name;
+        return name;
+    };
+
+    // the expressions of the activation functions in snn.cpp
+    static std::string ActivationCode(std::string id)
+    {
+        if (id == SNN_AF_ID_IDENTITY) return "";
+        if (id == SNN_AF_ID_BOOLEAN) return "out[o] = out[o] < 0.0 ? 0.0 : 1.0;";
+        if (id == SNN_AF_ID_SIGMOID) return "out[o] = 1.0 / (1.0 + std::pow(std::exp(1.0), -out[o]));";
+        if (id == SNN_AF_ID_HTANGENT) {
+            return "double epx = std::pow(std::exp(1.0), out[o]); "
+                "double enx = std::pow(std::exp(1.0), -out[o]); "
+                "out[o] = (epx - enx) / (epx + enx);";
+        }
+        throw std::invalid_argument("activation function " + id + " can not be exported");
+    };
+
+    std::string HeaderExporter::generate(Network* network, std::string source)
+    {
+        SPT_SCOPE("export");
+        auto& neurons = network->neurons;
+        int count = neurons.size();
+        if (count < 2) {
+            throw std::invalid_argument("an exported network needs an input and an output layer");
+        }
+
+        std::string identifier = ToIdentifier(this->name);
+        std::string guard = identifier;
+        std::transform(guard.begin(), guard.end(), guard.begin(), ::toupper);
+        guard += "_HPP";
+
+        int widest = 0;
+        for (const auto& layer : neurons) widest = std::max(widest, (int)layer.size());
+
+        std::string weights, code;
+
+        for (int l = 1; l < count; l++) {
+            if (network->isStructured(l)) {
+                throw std::invalid_argument("export does not support " + network->structures[l].type + " layers");
+            }
+
+            int inputs = neurons[l - 1].size();
+            int outputs = neurons[l].size();
+            std::vector<double> matrix((long)inputs * outputs, 0);
+            std::vector<int> unconnected;
+
+            auto first = neurons[l][0]->activationFunction;
+            std::string id = first == nullptr ? SNN_AF_ID_IDENTITY : first->getId();
+
+            for (const auto& neuron : neurons[l]) {
+                auto activationFunction = neuron->activationFunction;
+                if ((activationFunction == nullptr ? SNN_AF_ID_IDENTITY : activationFunction->getId()) != id) {
+                    throw std::invalid_argument("export needs one activation function per layer");
+                }
+                // the engine keeps neurons without inputs at 0
+                if (neuron->inputSynapses.empty()) unconnected.push_back(neuron->index);
+
+                for (const auto& synapse : neuron->inputSynapses) {
+                    if (synapse->inputNeuron->layer != l - 1) {
+                        throw std::invalid_argument("export does not support skip connections");
+                    }
+                    matrix[(long)synapse->inputNeuron->index * outputs + neuron->index] += synapse->getWeight();
+                }
+            }
+
+            std::string array = "weights" + std::to_string(l);
+            weights += "    // layer " + std::to_string(l) + ", [" + std::to_string(inputs)
+                + " inputs][" + std::to_string(outputs) + " outputs]\n";
+            weights += "    alignas(" + std::to_string(SNN_EXPORT_ALIGNMENT) + ") inline constexpr double "
+                + array + "[" + std::to_string(matrix.size()) + "] = {";
+            for (long i = 0; i < matrix.size(); i++) {
+                weights += i % SNN_EXPORT_VALUES_PER_LINE == 0 ? "\n        " : " ";
+                weights += FormatWeight(matrix[i]) + (i + 1 < matrix.size() ? "," : "");
+            }
+            weights += "\n    };\n\n";
+
+            // layers alternate between the two buffers, the last one writes the output
+            std::string in = l == 1 ? "input" : (l % 2 == 0 ? "odd" : "even");
+            std::string out = l == count - 1 ? "output" : (l % 2 == 1 ? "odd" : "even");
+            std::string size = std::to_string(outputs);
+
+            code += "        // layer " + std::to_string(l) + ": " + std::to_string(inputs) + " -> " + size + ", " + id + "\n";
+            code += "        {\n";
+            code += "            const double* in = " + in + ";\n";
+            code += "            double* out = " + out + ";\n";
+            code += "            for (int o = 0; o < " + size + "; o++) out[o] = 0;\n";
+            code += "            for (int i = 0; i < " + std::to_string(inputs) + "; i++) {\n";
+            code += "                const double x = in[i];\n";
+            code += "                if (x == 0) continue;\n";
+            code += "                const double* row = " + array + " + i * " + size + ";\n";
+            code += "                for (int o = 0; o < " + size + "; o++) out[o] += x * row[o];\n";
+            code += "            }\n";
+
+            if (id == SNN_AF_ID_SOFTMAX) {
+                code += "            double largest = out[0];\n";
+                code += "            for (int o = 1; o < " + size + "; o++) largest = out[o] > largest ? out[o] : largest;\n";
+                code += "            double total = 0;\n";
+                code += "            for (int o = 0; o < " + size + "; o++) {\n";
+                code += "                out[o] = std::exp(out[o] - largest);\n";
+                code += "                total += out[o];\n";
+                code += "            }\n";
+                code += "            double scale = 1.0 / total;\n";
+                code += "            for (int o = 0; o < " + size + "; o++) out[o] *= scale;\n";
+            } else if (!ActivationCode(id).empty()) {
+                code += "            for (int o = 0; o < " + size + "; o++) { " + ActivationCode(id) + " }\n";
+            }
+
+            for (const auto& o : unconnected) code += "            out[" + std::to_string(o) + "] = 0;\n";
+            code += "        }\n";
+        }
+
+        std::string header;
+        header += "// generated by snn-export" + (source.empty() ? "" : " from " + source) + ", do not edit\n";
+        header += "#ifndef " + guard + "\n";
+        header += "#define " + guard + "\n\n";
+        header += "#include <cmath>\n\n";
+        header += "namespace " + identifier + "\n{\n";
+        header += "    inline constexpr int inputs = " + std::to_string(neurons.front().size()) + ";\n";
+        header += "    inline constexpr int outputs = " + std::to_string(neurons.back().size()) + ";\n\n";
+        header += weights;
+        header += "    // input has `inputs` values, output receives `outputs` values\n";
+        header += "    inline void process(const double* input, double* output)\n    {\n";
+        header += "        double even[" + std::to_string(widest) + "];\n";
+        header += "        double odd[" + std::to_string(widest) + "];\n";
+        header += "        (void)even;\n        (void)odd;\n\n";
+        header += code;
+        header += "    }\n}\n\n";
+        header += "#endif\n";
+        return header;
+    };
+
+    void HeaderExporter::store(Network* network, std::string filePath, std::string source)
+    {
+        SCLT::WriteToFile(filePath, this->generate(network, source));
+    };
+};
@@ -0,0 +1,27 @@
+#include <iostream>
+#include <stdexcept>
+#include "../header/export.hpp"
+
+int main(int argc, char **argv)
+{
+    SCLT::CliArguments* arguments;
+    arguments = new SCLT::CliArguments(argc, argv, {
+        {'f', "file", "trained network to export", true},
+        {'o', "output", "header to write (default <file>.hpp)", true},
+        {'n', "name", "namespace of the generated code (default \"model\")", true}
+    }, 25);
+    if (!arguments->has("file")) {
+        throw std::invalid_argument("you have to provide --file");
+    }
+
+    auto network = new SNN::Network;
+    network->load(arguments->get("file"));
+
+    SNN::HeaderExporter exporter;
+    if (arguments->has("name")) exporter.name = arguments->get("name");
+    std::string output = arguments->has("output") ? arguments->get("output") : arguments->get("file") + ".hpp";
+    exporter.store(network, output, arguments->get("file"));
+
+    std::cerr << "wrote " << output << std::endl;
+    return 0;
+};
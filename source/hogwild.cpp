@@ -0,0 +1,141 @@
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include "../header/hogwild.hpp"
+#include "../header/optimizer.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    HogwildTrainer::HogwildTrainer(Network* network, int threads)
+    {
+        if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+        this->network = network;
+        this->threads = threads;
+        for (int t = 0; t < threads; t++) this->workspaces.push_back(new Workspace);
+        this->gradients.resize(threads);
+    };
+
+    HogwildTrainer::~HogwildTrainer()
+    {
+        for (auto workspace : this->workspaces) delete workspace;
+    };
+
+    void HogwildTrainer::train(
+        const std::vector<SCLT::DoubleVector>& inputs,
+        const std::vector<SCLT::DoubleVector>& expectedOutputs,
+        double epsilon
+    )
+    {
+        SPT_SCOPE("hogwild epoch");
+
+        if (inputs.size() != expectedOutputs.size()) {
+            throw std::invalid_argument("every input needs an expected output");
+        }
+        if (this->network->optimizer->getId() != SNN_OPTIMIZER_ID_SGD) {
+            throw std::invalid_argument("Hogwild training only supports " SNN_OPTIMIZER_ID_SGD);
+        }
+
+        // compiling reorders the parameters, it must not happen in a worker
+        if (!this->network->compiled) this->network->compile();
+
+        auto engine = this->network->engine;
+        double* weights = this->network->parameters.weights.data();
+        int size = this->network->parameters.size();
+        std::atomic<int> next(0);
+        std::atomic<long> updates(0);
+        std::vector<HogwildProgress> progress(this->threads);
+        std::vector<std::thread> workers;
+        long reported = 0, reportedSamples = 0;
+        double reportedLoss = 0;
+
+        for (int t = 0; t < this->threads; t++) {
+            workers.emplace_back([&, t, weights, size, epsilon]() {
+                if (this->pinned) SCLT::PinThread(SCLT::CpuTopology::shared()->getCpu(t));
+
+                // scratch is first touched here, so it lives on the node of its thread
+                auto workspace = this->workspaces[t];
+                this->gradients[t].assign(size, 0);
+                double* gradients = this->gradients[t].data();
+                std::vector<std::pair<int, int>> ranges;
+                long written = 0;
+                double loss = 0;
+                long count = 0;
+
+                for (int i = next++; i < inputs.size(); i = next++) {
+                    engine->forward(weights, workspace, inputs[i]);
+                    loss += engine->getLoss(workspace, expectedOutputs[i]);
+                    count++;
+                    progress[t].loss.store(loss, std::memory_order_relaxed);
+                    progress[t].samples.store(count, std::memory_order_relaxed);
+                    engine->backward(weights, gradients, workspace, expectedOutputs[i]);
+
+                    // same step as SGD::update, only the rows backward() wrote are touched
+                    ranges.clear();
+                    engine->markGradients(workspace, ranges);
+                    for (const auto& range : ranges) {
+                        for (int p = range.first; p < range.second; p++) {
+                            weights[p] -= epsilon * gradients[p];
+                            gradients[p] = 0;
+                        }
+                        written += range.second - range.first;
+                    }
+
+                    // the shared sample counter decides when a report is due, only thread 0 prints
+                    if (t != 0 || this->reportInterval <= 0 || !this->onReport) continue;
+                    if (std::min<long>(next, inputs.size()) < reported + this->reportInterval) continue;
+
+                    double total = 0;
+                    long samples = 0;
+                    for (auto& worker : progress) {
+                        total += worker.loss.load(std::memory_order_relaxed);
+                        samples += worker.samples.load(std::memory_order_relaxed);
+                    }
+                    reported = std::min<long>(next, inputs.size());
+                    if (samples > reportedSamples) {
+                        this->onReport(reported, (total - reportedLoss) / (samples - reportedSamples));
+                    }
+                    reportedLoss = total;
+                    reportedSamples = samples;
+                }
+
+                updates += written;
+            });
+        }
+
+        for (auto& worker : workers) worker.join();
+
+        double total = 0;
+        long count = 0;
+        for (auto& worker : progress) {
+            total += worker.loss;
+            count += worker.samples;
+        }
+        this->loss = count == 0 ? 0 : total / count;
+        this->updates += updates;
+        this->network->weightVersion++;
+    };
+
+    double HogwildTrainer::MeanSquaredError(
+        Network* network,
+        const std::vector<SCLT::DoubleVector>& inputs,
+        const std::vector<SCLT::DoubleVector>& expectedOutputs
+    )
+    {
+        double total = 0;
+        long count = 0;
+
+        for (int i = 0; i < inputs.size(); i++) {
+            auto output = network->process(inputs[i]);
+            for (int o = 0; o < output.size() && o < expectedOutputs[i].size(); o++) {
+                double error = expectedOutputs[i][o] - output[o];
+                total += error * error;
+                count++;
+            }
+        }
+
+        return count == 0 ? 0 : total / count;
+    };
+};
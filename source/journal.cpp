@@ -0,0 +1,336 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <stdexcept>
+#include "../header/journal.hpp"
+#include "../header/optimizer.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    static long FileSize(std::string path)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) return -1;
+        return file.tellg();
+    };
+
+    // calls apply for every record of the complete batches of a segment and
+    // returns the offset behind the last one, -1 if it is no journal segment
+    static long ReadSegment(
+        std::string path,
+        long& generation,
+        std::function<void(int32_t id, double value)> apply
+    )
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return -1;
+
+        std::string magic(std::string(SNN_JOURNAL_MAGIC).size(), '\0');
+        file.read(&magic[0], magic.size());
+        int64_t segmentGeneration;
+        file.read((char*)&segmentGeneration, sizeof(segmentGeneration));
+        if (!file || magic != SNN_JOURNAL_MAGIC) return -1;
+
+        generation = segmentGeneration;
+        long end = file.tellg();
+        std::vector<char> batch;
+
+        while (true) {
+            uint32_t count;
+            if (!file.read((char*)&count, sizeof(count))) break;
+
+            // a batch cut short by a crash is ignored as a whole
+            batch.resize((long)count * (sizeof(int32_t) + sizeof(double)));
+            if (!file.read(batch.data(), batch.size())) break;
+
+            for (long offset = 0; offset < batch.size(); offset += sizeof(int32_t) + sizeof(double)) {
+                int32_t id;
+                double value;
+                std::memcpy(&id, batch.data() + offset, sizeof(id));
+                std::memcpy(&value, batch.data() + offset + sizeof(id), sizeof(value));
+                if (apply) apply(id, value);
+            }
+            end = file.tellg();
+        }
+
+        return end;
+    };
+
+    WeightJournal::WeightJournal(Network* network, std::string filePath)
+    {
+        this->network = network;
+        this->filePath = filePath;
+    };
+
+    WeightJournal::~WeightJournal()
+    {
+        this->wait();
+    };
+
+    long WeightJournal::ReadGeneration(std::string journalPath)
+    {
+        long generation = -1;
+        if (ReadSegment(journalPath, generation, nullptr) < 0) return -1;
+        return generation;
+    };
+
+    long WeightJournal::Replay(Network* network, std::string journalPath)
+    {
+        SPT_SCOPE("journal replay");
+
+        long generation = -1;
+        if (ReadSegment(journalPath, generation, nullptr) < 0) return -1;
+        // the snapshot already contains every older segment
+        if (generation < network->journalGeneration) return 0;
+
+        auto& parameters = network->parameters;
+        std::unordered_map<int, int> indices;
+        for (int i = 0; i < parameters.size(); i++) {
+            if (parameters.ids[i] >= 0) indices[parameters.ids[i]] = i;
+        }
+
+        return ReadSegment(journalPath, generation, [&parameters, &indices](int32_t id, double value) {
+            auto index = indices.find(id);
+            if (index == indices.end()) {
+                throw std::invalid_argument("journal refers to unknown weight " + std::to_string(id));
+            }
+            parameters.weights[index->second] = value;
+        });
+    };
+
+    std::string WeightJournal::Merge(std::string snapshot, std::string journalPath, long generation)
+    {
+        std::unordered_map<int, double> values;
+        long segmentGeneration;
+        if (ReadSegment(journalPath, segmentGeneration, [&values](int32_t id, double value) {
+            values[id] = value;
+        }) < 0) {
+            throw std::invalid_argument("could not read journal \"" + journalPath + "\"");
+        }
+
+        auto commands = SCLT::PBag::fromString(snapshot, SCLT_PBAG_2_DELIMITER);
+        SCLT::PBag merged;
+        bool hasGeneration = false;
+        int position = 0;
+
+        SCLT::PBag generationCommand;
+        generationCommand.insert(SNN_SAVE_COMMAND_JOURNAL_GENERATION);
+        generationCommand.insert(std::to_string(generation));
+
+        // weights are numbered in file order: synapse weights, then layer weights
+        for (auto& command : commands.children) {
+            if (command.size() < 1) continue;
+            auto& arguments = command.children;
+            int first = -1;
+            if (arguments[0].value == SNN_SAVE_COMMAND_ADD_SYNAPSE) first = 3;
+            if (arguments[0].value == SNN_SAVE_COMMAND_ADD_LAYER) first = 12;
+
+            if (first >= 0) {
+                for (int i = first; i < arguments.size(); i++, position++) {
+                    auto value = values.find(position);
+                    if (value != values.end()) arguments[i].value = std::to_string(value->second);
+                }
+            }
+
+            if (arguments[0].value == SNN_SAVE_COMMAND_JOURNAL_GENERATION) {
+                command = generationCommand;
+                hasGeneration = true;
+            }
+
+            // store() keeps the generation in front of the optimizer state
+            if (!hasGeneration && (
+                arguments[0].value == SNN_SAVE_COMMAND_OPTIMIZER
+                || arguments[0].value == SNN_SAVE_COMMAND_OPTIMIZER_STATE
+            )) {
+                merged.insert(generationCommand);
+                hasGeneration = true;
+            }
+
+            merged.insert(command);
+        }
+
+        if (!hasGeneration) merged.insert(generationCommand);
+        return merged.toString(SCLT_PBAG_2_DELIMITER);
+    };
+
+    void WeightJournal::open()
+    {
+        SPT_SCOPE("journal open");
+
+        std::string journalPath = this->filePath + SNN_JOURNAL_SUFFIX;
+        std::string sealedPath = this->filePath + SNN_JOURNAL_SEALED_SUFFIX;
+
+        this->network->load(this->filePath);
+        // ids of a freshly loaded network are the positions in the file
+        long sealedEnd = Replay(this->network, sealedPath);
+        long journalEnd = Replay(this->network, journalPath);
+        long activeGeneration = ReadGeneration(journalPath);
+
+        // keep appending only to a complete segment of the current generation
+        if (sealedEnd >= 0
+            || journalEnd <= 0
+            || journalEnd != FileSize(journalPath)
+            || activeGeneration < this->network->journalGeneration
+        ) {
+            this->generation = std::max(this->network->journalGeneration, activeGeneration);
+            this->snapshot();
+            return;
+        }
+
+        this->generation = activeGeneration;
+        this->journalBytes = journalEnd;
+        this->snapshotBytes = FileSize(this->filePath);
+        this->segment.open(journalPath, std::ios::binary | std::ios::app);
+        if (!this->segment.is_open()) {
+            throw std::invalid_argument("could not open file \"" + journalPath + "\"");
+        }
+        this->remember();
+    };
+
+    void WeightJournal::snapshot()
+    {
+        SPT_SCOPE("journal snapshot");
+        this->wait();
+
+        // the new snapshot contains every segment up to the current one
+        this->generation++;
+        this->network->journalGeneration = this->generation;
+
+        std::string temporaryPath = this->filePath + ".tmp";
+        this->network->store(temporaryPath);
+        if (std::rename(temporaryPath.c_str(), this->filePath.c_str()) != 0) {
+            throw std::invalid_argument("could not replace file \"" + this->filePath + "\"");
+        }
+
+        this->snapshotBytes = FileSize(this->filePath);
+        std::remove((this->filePath + SNN_JOURNAL_SEALED_SUFFIX).c_str());
+        this->startSegment();
+        this->remember();
+    };
+
+    void WeightJournal::startSegment()
+    {
+        std::string journalPath = this->filePath + SNN_JOURNAL_SUFFIX;
+        if (this->segment.is_open()) this->segment.close();
+
+        this->segment.open(journalPath, std::ios::binary | std::ios::trunc);
+        if (!this->segment.is_open()) {
+            throw std::invalid_argument("could not open file \"" + journalPath + "\"");
+        }
+
+        int64_t generation = this->generation;
+        this->segment << SNN_JOURNAL_MAGIC;
+        this->segment.write((const char*)&generation, sizeof(generation));
+        this->segment.flush();
+        this->journalBytes = this->segment.tellp();
+    };
+
+    void WeightJournal::remember()
+    {
+        auto& parameters = this->network->parameters;
+        int count = 0;
+        for (const auto& id : parameters.ids) count = std::max(count, id + 1);
+
+        this->persisted.assign(count, 0);
+        for (int i = 0; i < parameters.size(); i++) {
+            if (parameters.ids[i] >= 0) this->persisted[parameters.ids[i]] = parameters.weights[i];
+        }
+        this->structureVersion = this->network->structureVersion;
+    };
+
+    int WeightJournal::commit()
+    {
+        SPT_SCOPE("journal commit");
+
+        // new or removed weights have no id in the snapshot
+        if (this->network->structureVersion != this->structureVersion) {
+            this->snapshot();
+            return 0;
+        }
+
+        auto& parameters = this->network->parameters;
+        std::vector<char> batch(sizeof(uint32_t));
+        uint32_t count = 0;
+
+        for (int i = 0; i < parameters.size(); i++) {
+            int32_t id = parameters.ids[i];
+            double value = parameters.weights[i];
+            if (id < 0 || this->persisted[id] == value) continue;
+
+            this->persisted[id] = value;
+            long offset = batch.size();
+            batch.resize(offset + sizeof(id) + sizeof(value));
+            std::memcpy(batch.data() + offset, &id, sizeof(id));
+            std::memcpy(batch.data() + offset + sizeof(id), &value, sizeof(value));
+            count++;
+        }
+
+        if (count == 0) return 0;
+
+        std::memcpy(batch.data(), &count, sizeof(count));
+        this->segment.write(batch.data(), batch.size());
+        this->segment.flush();
+        this->journalBytes += batch.size();
+        this->committedRecords += count;
+
+        if (this->journalBytes > this->compactRatio * this->snapshotBytes) this->compact();
+        return count;
+    };
+
+    void WeightJournal::compact()
+    {
+        if (this->compacting) return;
+        this->wait();
+
+        std::string journalPath = this->filePath + SNN_JOURNAL_SUFFIX;
+        std::string sealedPath = this->filePath + SNN_JOURNAL_SEALED_SUFFIX;
+
+        // a sealed segment left by a failed merge must not be overwritten
+        if (SCLT::FileExists(sealedPath)) {
+            this->snapshot();
+            return;
+        }
+
+        this->segment.close();
+        if (std::rename(journalPath.c_str(), sealedPath.c_str()) != 0) {
+            throw std::invalid_argument("could not seal journal \"" + journalPath + "\"");
+        }
+
+        // commits go to a new segment while the sealed one is merged
+        this->generation++;
+        this->network->journalGeneration = this->generation;
+        this->startSegment();
+
+        this->compacting = true;
+        std::string filePath = this->filePath;
+        long generation = this->generation;
+
+        this->compaction = std::thread([this, filePath, sealedPath, generation]() {
+            SPT_SCOPE("journal compact");
+            std::string temporaryPath = filePath + ".tmp";
+
+            // until the rename the old snapshot and the sealed segment are valid,
+            // after a failure open() replays both
+            try {
+                SCLT::WriteToFile(temporaryPath, Merge(SCLT::ReadFromFile(filePath), sealedPath, generation));
+                if (std::rename(temporaryPath.c_str(), filePath.c_str()) == 0) {
+                    std::remove(sealedPath.c_str());
+                }
+            } catch (std::exception& e) {
+                std::remove(temporaryPath.c_str());
+            }
+            this->compacting = false;
+        });
+    };
+
+    void WeightJournal::wait()
+    {
+        if (!this->compaction.joinable()) return;
+        this->compaction.join();
+        this->snapshotBytes = FileSize(this->filePath);
+    };
+};
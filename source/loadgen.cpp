@@ -0,0 +1,163 @@
+#include <cmath>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "../header/loadgen.hpp"
+
+namespace SNN
+{
+    double LoadResult::getThroughput()
+    {
+        return this->seconds > 0 ? this->latencies.size() / this->seconds : 0;
+    };
+
+    // nearest rank, latencies are sorted by run()
+    double LoadResult::getPercentile(double share)
+    {
+        if (this->latencies.empty()) return 0;
+        long rank = std::ceil(share * this->latencies.size());
+        return this->latencies[std::min(std::max(rank, 1L), (long)this->latencies.size()) - 1];
+    };
+
+    std::string LoadResult::toJson()
+    {
+        return "{\"requests\":" + std::to_string(this->requests)
+            + ",\"errors\":" + std::to_string(this->errors)
+            + ",\"rejected\":" + std::to_string(this->rejected)
+            + ",\"expired\":" + std::to_string(this->expired)
+            + ",\"seconds\":" + std::to_string(this->seconds)
+            + ",\"requests_per_sec\":" + std::to_string(this->getThroughput())
+            + ",\"p50_ms\":" + std::to_string(this->getPercentile(0.5) * 1000)
+            + ",\"p90_ms\":" + std::to_string(this->getPercentile(0.9) * 1000)
+            + ",\"p99_ms\":" + std::to_string(this->getPercentile(0.99) * 1000)
+            + ",\"p999_ms\":" + std::to_string(this->getPercentile(0.999) * 1000)
+            + ",\"max_ms\":" + std::to_string(this->getPercentile(1) * 1000)
+            + "}\n";
+    };
+
+    std::string LoadResult::toString()
+    {
+        return std::to_string(this->requests) + " requests  "
+            + std::to_string(this->errors) + " errors  "
+            + std::to_string(this->rejected) + " rejected  "
+            + std::to_string(this->expired) + " expired  "
+            + std::to_string(this->getThroughput()) + " requests/s\n"
+            + "latency ms  p50 " + std::to_string(this->getPercentile(0.5) * 1000)
+            + "  p90 " + std::to_string(this->getPercentile(0.9) * 1000)
+            + "  p99 " + std::to_string(this->getPercentile(0.99) * 1000)
+            + "  p999 " + std::to_string(this->getPercentile(0.999) * 1000)
+            + "  max " + std::to_string(this->getPercentile(1) * 1000);
+    };
+
+    void LoadGenerator::synthesize(int count, int checks, int inputs, int outputs, uint64_t seed)
+    {
+        uint64_t counter = 0;
+        this->payloads.clear();
+
+        for (int p = 0; p < count; p++) {
+            SCLT::PBag request;
+            for (int c = 0; c < checks; c++) {
+                SCLT::DoubleVector input, expected;
+                for (int i = 0; i < inputs; i++) input.push_back(SCLT::RandomUniform(seed, counter++));
+                for (int o = 0; o < outputs; o++) expected.push_back(SCLT::RandomUniform(seed, counter++));
+
+                // checks without expected values are only evaluated, not trained
+                SCLT::PBag check;
+                check.insert(SCLT::dvtosv(input));
+                if (outputs > 0) check.insert(SCLT::dvtosv(expected));
+                request.insert(check);
+            }
+            this->payloads.push_back(request.toString(SCLT_PBAG_3_DELIMITER));
+        }
+    };
+
+    void LoadGenerator::replay(std::string filePath)
+    {
+        std::ifstream file(filePath);
+        if (!file.is_open()) {
+            throw std::invalid_argument("could not open file \"" + filePath + "\"");
+        }
+
+        this->payloads.clear();
+        std::string line;
+        while (getline(file, line)) {
+            if (!line.empty()) this->payloads.push_back(line);
+        }
+    };
+
+    LoadResult LoadGenerator::run()
+    {
+        if (this->payloads.empty()) throw std::invalid_argument("no payloads to send");
+        if (this->connections < 1) throw std::invalid_argument("at least one connection is needed");
+
+        typedef std::chrono::steady_clock Clock;
+        STS::TcpClient client(this->host, this->port);
+        std::atomic<long> next(0);
+        std::vector<SCLT::DoubleVector> latencies(this->connections);
+        std::vector<long> errors(this->connections, 0);
+        std::vector<long> rejected(this->connections, 0);
+        std::vector<long> expired(this->connections, 0);
+        std::string prefix = this->deadline > 0 ? STC_DEADLINE_PREFIX + std::to_string(this->deadline) + "\n" : "";
+        std::vector<std::thread> threads;
+
+        auto start = Clock::now();
+        auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(this->seconds));
+
+        for (int c = 0; c < this->connections; c++) {
+            threads.emplace_back([this, c, &client, &next, &latencies, &errors, &rejected, &expired, &prefix, start, end]() {
+                while (true) {
+                    long i = next++;
+                    if (this->limit > 0 && i >= this->limit) break;
+
+                    auto scheduled = Clock::now();
+                    if (this->rate > 0) {
+                        scheduled = start + std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(i / this->rate)
+                        );
+                        if (scheduled >= end) break;
+                        std::this_thread::sleep_until(scheduled);
+                    } else if (scheduled >= end) {
+                        break;
+                    }
+
+                    try {
+                        auto response = client.request(prefix + this->payloads[i % this->payloads.size()]);
+                        if (response.empty() || response.compare(0, std::strlen(STC_RESPONSE_ERROR), STC_RESPONSE_ERROR) == 0) {
+                            errors[c]++;
+                            continue;
+                        }
+                        if (response == STC_RESPONSE_OVERLOADED) {
+                            rejected[c]++;
+                            continue;
+                        }
+                        if (response == STC_RESPONSE_EXPIRED) {
+                            expired[c]++;
+                            continue;
+                        }
+                        latencies[c].push_back(std::chrono::duration<double>(Clock::now() - scheduled).count());
+                    } catch (std::exception& e) {
+                        errors[c]++;
+                    }
+                }
+            });
+        }
+
+        for (auto& thread : threads) thread.join();
+
+        LoadResult result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        for (int c = 0; c < this->connections; c++) {
+            result.latencies.insert(result.latencies.end(), latencies[c].begin(), latencies[c].end());
+            result.errors += errors[c];
+            result.rejected += rejected[c];
+            result.expired += expired[c];
+        }
+        result.requests = result.latencies.size() + result.errors + result.rejected + result.expired;
+        std::sort(result.latencies.begin(), result.latencies.end());
+        return result;
+    };
+};
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <stdexcept>
+#include "../header/loadgen.hpp"
+
+int main(int argc, char **argv)
+{
+    SCLT::CliArguments* arguments;
+    arguments = new SCLT::CliArguments(argc, argv, {
+        {'a', "host", "server address (default 127.0.0.1)", true},
+        {'p', "port", "server port (default 8000)", true},
+        {'c', "connections", "concurrent connections (default 4)", true},
+        {'r', "rate", "requests per second over all connections (default closed loop)", true},
+        {'d', "duration", "seconds to run (default 10)", true},
+        {'n', "requests", "stop after this many requests", true},
+        {'l', "deadline", "deadline in ms sent with every request (default: the server's)", true},
+        {'f', "replay", "send the lines of this file as requests instead of synthetic checks", true},
+        {'k', "checks", "synthetic checks per request (default 10)", true},
+        {'i', "inputs", "inputs per synthetic check (default 3)", true},
+        {'e', "expected", "expected values per synthetic check, the server trains on them (default 0)", true},
+        {'s', "seed", "seed of the synthetic checks", true},
+        {'o', "output", "write JSON results to file", true},
+        {'h', "help", "show this help"}
+    }, 25);
+
+    SNN::LoadGenerator generator;
+    if (arguments->has("host")) generator.host = arguments->get("host");
+    if (arguments->has("port")) generator.port = std::stoi(arguments->get("port"));
+    if (arguments->has("connections")) generator.connections = std::stoi(arguments->get("connections"));
+    if (arguments->has("rate")) generator.rate = std::stod(arguments->get("rate"));
+    if (arguments->has("duration")) generator.seconds = std::stod(arguments->get("duration"));
+    if (arguments->has("requests")) generator.limit = std::stol(arguments->get("requests"));
+    if (arguments->has("deadline")) generator.deadline = std::stoi(arguments->get("deadline"));
+
+    if (arguments->has("replay")) {
+        generator.replay(arguments->get("replay"));
+    } else {
+        int checks = SNN_LOADGEN_DEFAULT_CHECKS;
+        int inputs = SNN_LOADGEN_DEFAULT_INPUTS;
+        int expected = 0;
+        uint64_t seed = 1;
+        if (arguments->has("checks")) checks = std::stoi(arguments->get("checks"));
+        if (arguments->has("inputs")) inputs = std::stoi(arguments->get("inputs"));
+        if (arguments->has("expected")) expected = std::stoi(arguments->get("expected"));
+        if (arguments->has("seed")) seed = std::stoull(arguments->get("seed"));
+        generator.synthesize(SNN_LOADGEN_PAYLOADS, checks, inputs, expected, seed);
+    }
+
+    auto result = generator.run();
+    std::cerr << result.toString() << std::endl;
+
+    if (arguments->has("output")) {
+        SCLT::WriteToFile(arguments->get("output"), result.toJson());
+    } else {
+        std::cout << result.toJson();
+    }
+
+    return 0;
+};
@@ -1,8 +1,13 @@
 #include <iostream>
 #include <fstream>
+#include <chrono>
 #include <algorithm>
 #include <stdexcept>
 #include "../header/mnist.hpp"
+#include "../header/prune.hpp"
+#include "../header/quantize.hpp"
+#include "../header/hogwild.hpp"
+#include "../header/spt.hpp"
 
 namespace SNN
 {
@@ -47,50 +52,127 @@ namespace SNN
         return result;
     };
 
-    bool MNIST_ProbabilityDigitCompare(MNIST_ProbabilityDigit a, MNIST_ProbabilityDigit b)
+    SCLT::DoubleVector MNIST_Test::toInput(MNIST_Digit& digit)
     {
-        return a.probability > b.probability;
+        SCLT::DoubleVector input;
+        // dense networks read a bias first, a shaped input layer is exactly the image
+        if (this->network->structures.count(0) == 0) {
+            input.push_back(1);
+        }
+
+        for (int x = 0; x < 28; x++) {
+            for (int y = 0; y < 28; y++) {
+                input.push_back( (digit.data[x][y] & 0xFF) / 255.0 );
+            }
+        }
+
+        return input;
     };
 
-    void MNIST_Test::test()
+    float MNIST_Test::evaluate(MNIST_DataSet& digits, std::function<SCLT::DoubleVector(SCLT::DoubleVector)> process)
     {
-        std::cout << "test" << std::endl;
-
         float correct = 0;
         float incorrect = 0;
 
-        for (int i = 0; i < this->digitsTest.size(); i++) {
-            SCLT::DoubleVector input;
-            input.push_back(1); // bias
+        for (int i = 0; i < digits.size(); i++) {
+            SCLT::DoubleVector input = this->toInput(digits[i]);
+            SCLT::DoubleVector output = process ? process(input) : network->process(input);
 
-            for (int x = 0; x < 28; x++) {
-                for (int y = 0; y < 28; y++) {
-                    input.push_back( (digitsTest[i].data[x][y] & 0xFF) / 255.0 );
-                }
+            if (digits[i].label == ArgMax(output)) {
+                correct++;
+            } else {
+                incorrect++;
             }
+        }
+
+        return correct / std::max(1.0f, correct + incorrect);
+    };
+
+    float MNIST_Test::test(std::function<SCLT::DoubleVector(SCLT::DoubleVector)> process)
+    {
+        if (!this->quiet) std::cout << "test" << std::endl;
+        float percentage = this->evaluate(this->digitsTest, process);
+        if (!this->quiet) std::cout << "result: " << std::to_string(percentage) << std::endl;
+        return percentage;
+    };
+
+    void MNIST_Test::train(double epsilon)
+    {
+        SPT_SCOPE("epoch");
+        if (!this->quiet) std::cout << "train" << std::endl;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&start]() {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+        auto report = [this, &elapsed](long samples, double loss) {
+            if (this->quiet) return;
+            std::cout << "samples: " << samples
+                << ", loss (" << this->lossId << "): " << loss
+                << ", samples/s: " << samples / std::max(elapsed(), 1e-9) << std::endl;
+        };
 
-            SCLT::DoubleVector output = network->process(input);
+        if (!this->network->compiled) this->network->compile();
+        this->lossId = this->network->engine->getLossId();
 
-            MNIST_ProbabilityDigit probs[10];
-            for (int k = 0; k < 10; k++) {
-                probs[k].digit = k;
-                probs[k].probability = output[k];
+        if (this->hogwildThreads > 0) {
+            std::vector<SCLT::DoubleVector> inputs, expectedOutputs;
+            for (auto& digit : this->digitsTrain) {
+                SCLT::DoubleVector expected = {0,0,0,0,0,0,0,0,0,0};
+                expected[digit.label] = 1;
+                inputs.push_back(this->toInput(digit));
+                expectedOutputs.push_back(expected);
             }
 
-            std::sort(probs, probs + 10, MNIST_ProbabilityDigitCompare);
+            HogwildTrainer trainer(this->network, this->hogwildThreads);
+            trainer.pinned = this->pinned;
+            trainer.reportInterval = this->reportInterval;
+            trainer.onReport = report;
+            trainer.train(inputs, expectedOutputs, epsilon);
+            this->trainLoss = trainer.loss;
+            this->samplesPerSecond = inputs.size() / std::max(elapsed(), 1e-9);
+            return;
+        }
 
-            if (this->digitsTest[i].label == probs[0].digit) {
-                correct++;
-            } else {
-                incorrect++;
+        // outputs are computed before each update, so the loss runs along for free
+        double epochLoss = 0, runningLoss = 0;
+        int running = 0;
+
+        for (int i = 0; i < this->digitsTrain.size(); i++) {
+            SCLT::DoubleVector input = this->toInput(this->digitsTrain[i]);
+            SCLT::DoubleVector expected = {0,0,0,0,0,0,0,0,0,0};
+            expected[this->digitsTrain[i].label] = 1;
+
+            network->process(input, expected, epsilon);
+            double loss = this->network->engine->getLoss(this->network->workspace, expected);
+            epochLoss += loss;
+            runningLoss += loss;
+            running++;
+
+            if (this->reportInterval > 0 && running == this->reportInterval) {
+                report(i + 1, runningLoss / running);
+                runningLoss = 0;
+                running = 0;
             }
         }
 
-        float percentage = correct / (correct + incorrect);
-        std::cout << "result: " << std::to_string(percentage) << std::endl;
+        this->trainLoss = epochLoss / std::max<size_t>(1, this->digitsTrain.size());
+        this->samplesPerSecond = this->digitsTrain.size() / std::max(elapsed(), 1e-9);
     };
 
-    void MNIST_Test::execute(std::string networkSaveFilePath, std::string mnistFilesRootPath)
+    void MNIST_Test::splitValidation()
+    {
+        // the tail of the training file, the same digits on every run
+        int count = this->digitsTrain.size() * this->validationShare;
+        this->digitsValidation.assign(this->digitsTrain.end() - count, this->digitsTrain.end());
+        this->digitsTrain.resize(this->digitsTrain.size() - count);
+    };
+
+    void MNIST_Test::createNetwork()
+    {
+        this->network->loadShort(this->definition);
+    };
+
+    void MNIST_Test::loadData(std::string mnistFilesRootPath)
     {
         this->digitsTrain = this->decoder->loadDataSet(
             mnistFilesRootPath + "train-images.idx3-ubyte",
@@ -101,54 +183,149 @@ namespace SNN
             mnistFilesRootPath + "t10k-images.idx3-ubyte",
             mnistFilesRootPath + "t10k-labels.idx1-ubyte"
         );
+    };
 
+    void MNIST_Test::loadNetwork(std::string networkSaveFilePath)
+    {
         if (SCLT::FileExists(networkSaveFilePath)) {
             this->network->load(networkSaveFilePath);
         } else {
-            this->network->addLayer(1+(28*28));
-            this->network->addLayer(10, SNN_AF_ID_SIGMOID);
-            this->network->createSynapses();
+            this->createNetwork();
         }
 
-        double epsilon = 0.01;
+        if (!this->optimizer.empty()) {
+            this->network->setOptimizer(this->optimizer);
+        }
+    };
 
-        while(true) {
-            std::cout << "train" << std::endl;
+    void MNIST_Test::execute(std::string networkSaveFilePath, std::string mnistFilesRootPath)
+    {
+        this->loadData(mnistFilesRootPath);
+        this->splitValidation();
+        bool resumed = SCLT::FileExists(networkSaveFilePath);
+        this->loadNetwork(networkSaveFilePath);
 
-            for (int i = 0; i < digitsTrain.size(); i++) {
-                SCLT::DoubleVector input;
-                input.push_back(1); // bias
+        // checkpoints are never picked on the test digits, without a validation
+        // split every epoch is stored and only --epochs stops the training
+        bool validated = !this->digitsValidation.empty();
+        if (!validated && this->maxEpochs <= 0) {
+            throw std::invalid_argument("training without validation digits needs a maximum number of epochs");
+        }
 
-                for (int x = 0; x < 28; x++) {
-                    for (int y = 0; y < 28; y++) {
-                        input.push_back( (digitsTrain[i].data[x][y] & 0xFF) / 255.0 );
-                    }
-                }
+        auto start = std::chrono::steady_clock::now();
+        double epsilon = this->epsilon;
+        double samples = 0;
 
-                SCLT::DoubleVector expected = {0,0,0,0,0,0,0,0,0,0};
-                expected[digitsTrain[i].label] = 1;
+        // a stored model is only replaced by a better one
+        float best = resumed && validated ? this->evaluate(this->digitsValidation) : -1;
+        int epoch = 0, bestEpoch = 0, stale = 0;
+        std::string stopped = "max-epochs";
+
+        while (this->maxEpochs <= 0 || epoch < this->maxEpochs) {
+            epoch++;
+            this->train(epsilon);
+            samples += this->digitsTrain.size();
 
-                network->process(input, expected, epsilon);
+            std::cout << "epoch: " << epoch
+                << ", loss (" << this->lossId << "): " << this->trainLoss
+                << ", samples/s: " << this->samplesPerSecond;
+
+            float accuracy = 0;
+            if (validated) {
+                accuracy = this->evaluate(this->digitsValidation);
+                std::cout << ", validation: " << accuracy;
             }
 
-            this->test();
-            this->network->store(networkSaveFilePath);
-            epsilon *= 0.9;
+            if (!validated || accuracy > best) {
+                best = accuracy;
+                bestEpoch = epoch;
+                stale = 0;
+                this->network->store(networkSaveFilePath);
+                std::cout << ", stored";
+            } else {
+                stale++;
+            }
+            std::cout << std::endl;
+
+            if (this->onEpoch) this->onEpoch();
+            if (validated && this->patience > 0 && stale >= this->patience) {
+                stopped = "patience";
+                break;
+            }
+            epsilon *= this->decay;
         }
+
+        // the test accuracy is the one of the checkpoint
+        if (SCLT::FileExists(networkSaveFilePath)) this->network->load(networkSaveFilePath);
+        float accuracy = this->test();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::string summary = "{\"epochs\":" + std::to_string(epoch)
+            + ",\"best_epoch\":" + std::to_string(bestEpoch)
+            + ",\"validation_accuracy\":" + (validated ? std::to_string(best) : "null")
+            + ",\"test_accuracy\":" + std::to_string(accuracy)
+            + ",\"loss\":\"" + this->lossId + "\""
+            + ",\"train_loss\":" + std::to_string(this->trainLoss)
+            + ",\"samples_per_sec\":" + std::to_string(samples / std::max(seconds, 1e-9))
+            + ",\"seconds\":" + std::to_string(seconds)
+            + ",\"stopped\":\"" + stopped + "\""
+            + "}\n";
+        std::cout << summary;
+        if (!this->summaryPath.empty()) SCLT::WriteToFile(this->summaryPath, summary);
     };
-};
 
-int main(int argc, char **argv)
-{
-    SCLT::CliArguments* arguments;
-    arguments = new SCLT::CliArguments(argc, argv, {
-        {'f', "file", "file for storing network", true},
-        {'m', "mnist", "specify data directory to run MNIST test", true}
-    }, 25);
-    if (!arguments->has("file")) {
-        throw std::invalid_argument("you have to provide --file");
-    }
-    auto MNIST = new SNN::MNIST_Test;
-    MNIST->execute(arguments->get("file"), arguments->get("mnist") + "/");
-    return 0;
+    void MNIST_Test::prune(
+        std::string networkSaveFilePath,
+        std::string mnistFilesRootPath,
+        double targetSparsity,
+        int steps,
+        bool perLayer
+    )
+    {
+        this->loadData(mnistFilesRootPath);
+        this->loadNetwork(networkSaveFilePath);
+
+        Pruner pruner;
+        pruner.perLayer = perLayer;
+        double initial = pruner.countSynapses(this->network);
+
+        std::cout << "synapses: " << initial << std::endl;
+        this->test();
+
+        pruner.schedule(this->network, targetSparsity, steps, [this, &pruner](int step) {
+            std::cout << "prune step " << step
+                << ", synapses: " << pruner.countSynapses(this->network) << std::endl;
+            this->train(this->epsilon);
+            this->test();
+            if (this->onEpoch) this->onEpoch();
+        });
+
+        this->network->store(networkSaveFilePath);
+    };
+
+    void MNIST_Test::quantize(
+        std::string networkSaveFilePath,
+        std::string mnistFilesRootPath,
+        int calibrationSize
+    )
+    {
+        this->loadData(mnistFilesRootPath);
+        this->loadNetwork(networkSaveFilePath);
+
+        std::vector<SCLT::DoubleVector> calibrationInputs;
+        for (int i = 0; i < calibrationSize && i < this->digitsTrain.size(); i++) {
+            calibrationInputs.push_back(this->toInput(this->digitsTrain[i]));
+        }
+
+        QuantizedNetwork quantized(this->network->afRegistry);
+        quantized.quantize(this->network, calibrationInputs);
+        quantized.store(networkSaveFilePath + SNN_QUANTIZED_FILE_SUFFIX);
+
+        std::cout << "float" << std::endl;
+        this->test();
+        std::cout << "int8 (" << DotProductImplementation() << ")" << std::endl;
+        this->test([&quantized](SCLT::DoubleVector input) {
+            return quantized.process(input);
+        });
+    };
 };
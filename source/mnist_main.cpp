@@ -0,0 +1,79 @@
+#include <iostream>
+#include <stdexcept>
+#include "../header/mnist.hpp"
+#include "../header/prune.hpp"
+#include "../header/tuner.hpp"
+#include "../header/spt.hpp"
+
+int main(int argc, char **argv)
+{
+    SCLT::CliArguments* arguments;
+    arguments = new SCLT::CliArguments(argc, argv, {
+        {'f', "file", "file for storing network", true},
+        {'m', "mnist", "specify data directory to run MNIST test", true},
+        {'n', "network", "definition of a new network (default \"785;10,Softmax\", e.g. \"1:28:28;Conv:8:5,Sigmoid,He;MaxPool:2;10,Softmax\")", true},
+        {'o', "optimizer", "optimizer and settings (e.g. \"Adam\"; default SGD)", true},
+        {'e', "epsilon", "learning rate (default 0.01)", true},
+        {'r', "seed", "seed for the weight initialization of a new network", true},
+        {'d', "decay", "learning rate decay per epoch (default 0.9)", true},
+        {'v', "validation", "share of the training digits held out for validation (default 0.1; 0 stores every epoch and needs --epochs)", true},
+        {'w', "patience", "epochs without a better validation accuracy before training stops (default 3, 0 never stops)", true},
+        {'E', "epochs", "maximum number of epochs", true},
+        {'S', "summary", "also write the JSON summary of the run to this file", true},
+        {'H', "hogwild", "train with this many lock-free threads (SGD only)", true},
+        {'R', "pin", "pin training threads to cpus spread over the NUMA nodes"},
+        {'u', "tune", "measure kernel blockings for this host on first use and cache them in this file", true},
+        {'p', "prune", "prune to this share of removed weights (e.g. 0.9), fine-tuning one epoch per step", true},
+        {'P', "prune-steps", "number of prune and fine-tune steps (default 5)", true},
+        {'l', "prune-per-layer", "use a magnitude threshold per layer instead of a global one"},
+        {'q', "quantize", "store an int8 copy of the network next to --file and compare its accuracy"},
+        {'t', "trace", "write a chrome trace to file after every epoch", true},
+        {'T', "trace-summary", "print aggregated trace timings after every epoch"}
+    }, 25);
+    if (!arguments->has("file")) {
+        throw std::invalid_argument("you have to provide --file");
+    }
+    auto MNIST = new SNN::MNIST_Test;
+    if (arguments->has("network")) MNIST->definition = arguments->get("network");
+    if (arguments->has("optimizer")) MNIST->optimizer = arguments->get("optimizer");
+    if (arguments->has("epsilon")) MNIST->epsilon = std::stod(arguments->get("epsilon"));
+    if (arguments->has("seed")) MNIST->network->seed = std::stoull(arguments->get("seed"));
+    if (arguments->has("decay")) MNIST->decay = std::stod(arguments->get("decay"));
+    if (arguments->has("validation")) MNIST->validationShare = std::stod(arguments->get("validation"));
+    if (arguments->has("patience")) MNIST->patience = std::stoi(arguments->get("patience"));
+    if (arguments->has("epochs")) MNIST->maxEpochs = std::stoi(arguments->get("epochs"));
+    if (arguments->has("summary")) MNIST->summaryPath = arguments->get("summary");
+    if (arguments->has("hogwild")) MNIST->hogwildThreads = std::stoi(arguments->get("hogwild"));
+    if (arguments->has("pin")) {
+        MNIST->pinned = true;
+        SCLT::ThreadPool::pinShared = true;
+        SCLT::PinThread(SCLT::CpuTopology::shared()->getCpu(0));
+    }
+    if (arguments->has("tune")) MNIST->network->tuner = new SNN::KernelTuner(arguments->get("tune"));
+    if (arguments->has("trace") || arguments->has("trace-summary")) {
+        SPT::Enable();
+        MNIST->onEpoch = [arguments]() {
+            if (arguments->has("trace")) SPT::WriteChromeJson(arguments->get("trace"));
+            if (arguments->has("trace-summary")) std::cout << SPT::ToSummary() << std::endl;
+            SPT::Reset();
+        };
+    }
+    if (arguments->has("prune")) {
+        int steps = SNN_DEFAULT_PRUNE_STEPS;
+        if (arguments->has("prune-steps")) steps = std::stoi(arguments->get("prune-steps"));
+        MNIST->prune(
+            arguments->get("file"),
+            arguments->get("mnist") + "/",
+            std::stod(arguments->get("prune")),
+            steps,
+            arguments->has("prune-per-layer")
+        );
+        return 0;
+    }
+    if (arguments->has("quantize")) {
+        MNIST->quantize(arguments->get("file"), arguments->get("mnist") + "/");
+        return 0;
+    }
+    MNIST->execute(arguments->get("file"), arguments->get("mnist") + "/");
+    return 0;
+};
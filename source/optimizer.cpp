@@ -0,0 +1,263 @@
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include "../header/optimizer.hpp"
+
+namespace SNN
+{
+    // std::to_string would round away small values like Adam's epsilon or second moments
+    static std::string FormatDouble(double value)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.9g", value);
+        return buffer;
+    };
+
+    int Optimizer::getStateSize()
+    {
+        return 0;
+    };
+
+    SCLT::DoubleVector Optimizer::getHyperParameters()
+    {
+        return {};
+    };
+
+    void Optimizer::setHyperParameters(SCLT::DoubleVector values)
+    {
+    };
+
+    void Optimizer::step(Parameters* parameters, double rate)
+    {
+        int size = parameters->size();
+
+        this->state.resize(this->getStateSize());
+        for (auto& buffer : this->state) {
+            buffer.resize(size, 0);
+        }
+
+        this->steps++;
+        this->update(parameters->weights.data(), parameters->gradients.data(), size, rate);
+    };
+
+    void Optimizer::reset()
+    {
+        this->state.clear();
+        this->steps = 0;
+    };
+
+    void Optimizer::remap(const std::vector<int>& source)
+    {
+        for (auto& buffer : this->state) {
+            if (buffer.empty()) continue;
+            SCLT::DoubleVector remapped(source.size(), 0);
+            for (int i = 0; i < source.size(); i++) {
+                if (source[i] >= 0 && source[i] < buffer.size()) remapped[i] = buffer[source[i]];
+            }
+            buffer.swap(remapped);
+        }
+    };
+
+    SCLT::PBag Optimizer::store(std::vector<int> order)
+    {
+        SCLT::PBag commands;
+
+        SCLT::PBag settings;
+        settings.insert(SNN_SAVE_COMMAND_OPTIMIZER);
+        settings.insert(this->getId());
+        settings.insert(std::to_string(this->steps));
+        for (const auto& value : this->getHyperParameters()) {
+            settings.insert(FormatDouble(value));
+        }
+        commands.insert(settings);
+
+        for (int k = 0; k < this->state.size(); k++) {
+            SCLT::PBag command;
+            command.insert(SNN_SAVE_COMMAND_OPTIMIZER_STATE);
+            command.insert(std::to_string(k));
+            for (const auto& index : order) {
+                double value = index < this->state[k].size() ? this->state[k][index] : 0;
+                command.insert(FormatDouble(value));
+            }
+            commands.insert(command);
+        }
+
+        return commands;
+    };
+
+    void Optimizer::loadSettings(SCLT::PBag arguments)
+    {
+        this->reset();
+        this->steps = std::stol(arguments[2].value);
+
+        SCLT::DoubleVector values;
+        for (int i = 3; i < arguments.size(); i++) {
+            values.push_back(std::stod(arguments[i].value));
+        }
+        this->setHyperParameters(values);
+    };
+
+    void Optimizer::loadState(SCLT::PBag arguments)
+    {
+        int k = std::stoi(arguments[1].value);
+        if (k < 0 || k >= this->getStateSize()) {
+            throw std::invalid_argument("unexpected state buffer " + std::to_string(k)
+                + " for optimizer \"" + this->getId() + "\"");
+        }
+
+        this->state.resize(this->getStateSize());
+        this->state[k].clear();
+        for (int i = 2; i < arguments.size(); i++) {
+            this->state[k].push_back(std::stod(arguments[i].value));
+        }
+    };
+
+    Optimizer* Optimizer::create(std::string definition)
+    {
+        auto args = SCLT::PBag::fromString(definition, SCLT_PBAG_1_DELIMITER);
+        std::string id = args.size() > 0 ? args[0].value : SNN_OPTIMIZER_ID_SGD;
+
+        Optimizer* optimizer;
+        if (id == SNN_OPTIMIZER_ID_SGD) optimizer = new SGD;
+        else if (id == SNN_OPTIMIZER_ID_MOMENTUM) optimizer = new Momentum;
+        else if (id == SNN_OPTIMIZER_ID_NESTEROV) optimizer = new Nesterov;
+        else if (id == SNN_OPTIMIZER_ID_ADAM) optimizer = new Adam;
+        else if (id == SNN_OPTIMIZER_ID_ADAMW) optimizer = new AdamW;
+        else throw std::invalid_argument("no optimizer with id \"" + id + "\"");
+
+        if (args.size() > 1) {
+            auto values = optimizer->getHyperParameters();
+            for (int i = 1; i < args.size() && i - 1 < values.size(); i++) {
+                values[i - 1] = std::stod(args[i].value);
+            }
+            optimizer->setHyperParameters(values);
+        }
+
+        return optimizer;
+    };
+
+    std::string SGD::getId()
+    {
+        return SNN_OPTIMIZER_ID_SGD;
+    };
+
+    void SGD::update(double* weights, double* gradients, int size, double rate)
+    {
+        double* __restrict w = weights;
+        double* __restrict g = gradients;
+
+        for (int i = 0; i < size; i++) {
+            w[i] -= rate * g[i];
+            g[i] = 0;
+        }
+    };
+
+    std::string Momentum::getId()
+    {
+        return SNN_OPTIMIZER_ID_MOMENTUM;
+    };
+
+    int Momentum::getStateSize()
+    {
+        return 1;
+    };
+
+    SCLT::DoubleVector Momentum::getHyperParameters()
+    {
+        return {this->momentum};
+    };
+
+    void Momentum::setHyperParameters(SCLT::DoubleVector values)
+    {
+        if (values.size() > 0) this->momentum = values[0];
+    };
+
+    void Momentum::update(double* weights, double* gradients, int size, double rate)
+    {
+        double* __restrict w = weights;
+        double* __restrict g = gradients;
+        double* __restrict v = this->state[0].data();
+        const double mu = this->momentum;
+
+        for (int i = 0; i < size; i++) {
+            v[i] = mu * v[i] + g[i];
+            w[i] -= rate * v[i];
+            g[i] = 0;
+        }
+    };
+
+    std::string Nesterov::getId()
+    {
+        return SNN_OPTIMIZER_ID_NESTEROV;
+    };
+
+    void Nesterov::update(double* weights, double* gradients, int size, double rate)
+    {
+        double* __restrict w = weights;
+        double* __restrict g = gradients;
+        double* __restrict v = this->state[0].data();
+        const double mu = this->momentum;
+
+        for (int i = 0; i < size; i++) {
+            v[i] = mu * v[i] + g[i];
+            w[i] -= rate * (g[i] + mu * v[i]);
+            g[i] = 0;
+        }
+    };
+
+    std::string Adam::getId()
+    {
+        return SNN_OPTIMIZER_ID_ADAM;
+    };
+
+    int Adam::getStateSize()
+    {
+        return 2;
+    };
+
+    SCLT::DoubleVector Adam::getHyperParameters()
+    {
+        return {this->beta1, this->beta2, this->epsilon, this->weightDecay};
+    };
+
+    void Adam::setHyperParameters(SCLT::DoubleVector values)
+    {
+        if (values.size() > 0) this->beta1 = values[0];
+        if (values.size() > 1) this->beta2 = values[1];
+        if (values.size() > 2) this->epsilon = values[2];
+        if (values.size() > 3) this->weightDecay = values[3];
+    };
+
+    void Adam::update(double* weights, double* gradients, int size, double rate)
+    {
+        double* __restrict w = weights;
+        double* __restrict g = gradients;
+        double* __restrict m = this->state[0].data();
+        double* __restrict v = this->state[1].data();
+
+        const double b1 = this->beta1;
+        const double b2 = this->beta2;
+        const double eps = this->epsilon;
+        // bias corrections folded into the step size and the second moment scale
+        const double stepSize = rate / (1.0 - std::pow(b1, this->steps));
+        const double vScale = 1.0 / (1.0 - std::pow(b2, this->steps));
+        const double decay = 1.0 - rate * this->weightDecay;
+
+        for (int i = 0; i < size; i++) {
+            m[i] = b1 * m[i] + (1.0 - b1) * g[i];
+            v[i] = b2 * v[i] + (1.0 - b2) * g[i] * g[i];
+            w[i] = decay * w[i] - stepSize * m[i] / (std::sqrt(v[i] * vScale) + eps);
+            g[i] = 0;
+        }
+    };
+
+    AdamW::AdamW()
+    {
+        this->weightDecay = SNN_DEFAULT_WEIGHT_DECAY;
+    };
+
+    std::string AdamW::getId()
+    {
+        return SNN_OPTIMIZER_ID_ADAMW;
+    };
+};
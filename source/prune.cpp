@@ -0,0 +1,96 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "../header/prune.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    double Pruner::getThreshold(int layer)
+    {
+        if (this->layerThresholds.count(layer) > 0) return this->layerThresholds[layer];
+        return this->threshold;
+    };
+
+    int Pruner::prune(Network* network)
+    {
+        SPT_SCOPE("prune");
+
+        int removed = network->removeSynapses([this](Synapse* synapse) {
+            return std::fabs(synapse->getWeight()) < this->getThreshold(synapse->outputNeuron->layer);
+        });
+
+        network->removeDeadNeurons();
+        network->compact();
+        return removed;
+    };
+
+    double Pruner::magnitudeQuantile(Network* network, double sparsity, int layer)
+    {
+        SCLT::DoubleVector magnitudes;
+        for (const auto& neuronLayer : network->neurons) {
+            for (const auto& neuron : neuronLayer) {
+                if (layer >= 0 && neuron->layer != layer) continue;
+                for (const auto& synapse : neuron->inputSynapses) {
+                    magnitudes.push_back(std::fabs(synapse->getWeight()));
+                }
+            }
+        }
+
+        int count = sparsity * magnitudes.size();
+        if (count <= 0) return 0;
+        if (count >= magnitudes.size()) return std::numeric_limits<double>::infinity();
+
+        std::nth_element(magnitudes.begin(), magnitudes.begin() + count, magnitudes.end());
+        return magnitudes[count];
+    };
+
+    void Pruner::setSparsity(Network* network, double sparsity)
+    {
+        this->layerThresholds.clear();
+
+        if (!this->perLayer) {
+            this->threshold = this->magnitudeQuantile(network, sparsity);
+            return;
+        }
+
+        for (int l = 1; l < network->neurons.size(); l++) {
+            this->layerThresholds[l] = this->magnitudeQuantile(network, sparsity, l);
+        }
+    };
+
+    int Pruner::countSynapses(Network* network)
+    {
+        int count = 0;
+        for (const auto& neuronLayer : network->neurons) {
+            for (const auto& neuron : neuronLayer) count += neuron->inputSynapses.size();
+        }
+        return count;
+    };
+
+    void Pruner::schedule(
+        Network* network,
+        double targetSparsity,
+        int steps,
+        std::function<void(int step)> finetune
+    )
+    {
+        double initial = this->countSynapses(network);
+
+        for (int step = 1; step <= steps; step++) {
+            // cubic ramp: prune hard while there are many small weights, gently at the end
+            double progress = 1.0 - (double)step / steps;
+            double sparsity = targetSparsity * (1.0 - progress * progress * progress);
+            double current = this->countSynapses(network);
+            if (current <= 0) return;
+
+            double fraction = 1.0 - initial * (1.0 - sparsity) / current;
+            if (fraction > 0) {
+                this->setSparsity(network, fraction);
+                this->prune(network);
+            }
+
+            if (finetune) finetune(step);
+        }
+    };
+};
@@ -0,0 +1,317 @@
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "../header/quantize.hpp"
+#include "../header/engine.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    static int32_t DotProductScalar(const uint8_t* a, const int8_t* b, int size)
+    {
+        int32_t sum = 0;
+        for (int i = 0; i < size; i++) sum += (int32_t)a[i] * (int32_t)b[i];
+        return sum;
+    };
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2")))
+    static int32_t DotProductAvx2(const uint8_t* a, const int8_t* b, int size)
+    {
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i sum = _mm256_setzero_si256();
+
+        for (int i = 0; i < size; i += SNN_QUANTIZED_ROW_ALIGNMENT) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+            // u8 x s8 pairs into s16 (pmaddubsw), then pairs of s16 into s32
+            __m256i pairs = _mm256_maddubs_epi16(va, vb);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pairs, ones));
+        }
+
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_hadd_epi32(half, half);
+        half = _mm_hadd_epi32(half, half);
+        return _mm_cvtsi128_si32(half);
+    };
+
+    __attribute__((target("avx512vnni,avx512vl")))
+    static int32_t DotProductVnni(const uint8_t* a, const int8_t* b, int size)
+    {
+        __m256i sum = _mm256_setzero_si256();
+
+        for (int i = 0; i < size; i += SNN_QUANTIZED_ROW_ALIGNMENT) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+            sum = _mm256_dpbusd_epi32(sum, va, vb);
+        }
+
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_hadd_epi32(half, half);
+        half = _mm_hadd_epi32(half, half);
+        return _mm_cvtsi128_si32(half);
+    };
+#endif
+
+    typedef int32_t (*DotProductFunction)(const uint8_t*, const int8_t*, int);
+
+    static DotProductFunction SelectDotProduct(std::string& name)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")) {
+            name = "avx512-vnni";
+            return DotProductVnni;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            name = "avx2";
+            return DotProductAvx2;
+        }
+#endif
+        name = "scalar";
+        return DotProductScalar;
+    };
+
+    static std::string dotProductName;
+    static DotProductFunction dotProduct = SelectDotProduct(dotProductName);
+
+    int32_t DotProductU8S8(const uint8_t* a, const int8_t* b, int size)
+    {
+        return dotProduct(a, b, size);
+    };
+
+    std::string DotProductImplementation()
+    {
+        return dotProductName;
+    };
+
+    QuantizedNetwork::QuantizedNetwork(ActivationFunctionRegistry* afRegistry)
+    {
+        if (afRegistry == nullptr) {
+            afRegistry = new ActivationFunctionRegistry;
+            afRegistry->add(new SNN::Sigmoid);
+            afRegistry->add(new SNN::HyperbolicTangent);
+            afRegistry->add(new SNN::Softmax);
+            afRegistry->add(new SNN::Identity);
+        }
+
+        this->afRegistry = afRegistry;
+    };
+
+    void QuantizedNetwork::quantize(Network* network, std::vector<SCLT::DoubleVector> calibrationInputs)
+    {
+        SPT_SCOPE("quantize");
+
+        if (!network->compiled) network->compile();
+        if (!network->engine->isLayered()) {
+            throw std::invalid_argument("quantization needs a strictly layered network");
+        }
+        for (int l = 0; l < network->neurons.size(); l++) {
+            if (network->isStructured(l)) {
+                throw std::invalid_argument("quantization does not support " + network->structures[l].type + " layers");
+            }
+        }
+        if (calibrationInputs.empty()) {
+            throw std::invalid_argument("quantization needs calibration inputs");
+        }
+
+        auto& neurons = network->neurons;
+        int count = neurons.size();
+
+        // observed value range of every layer, always including 0
+        SCLT::DoubleVector minimum(count, 0), maximum(count, 0);
+        for (const auto& input : calibrationInputs) {
+            network->process(input);
+            for (int l = 0; l < count; l++) {
+                for (const auto& value : network->workspace->values[l]) {
+                    minimum[l] = std::min(minimum[l], value);
+                    maximum[l] = std::max(maximum[l], value);
+                }
+            }
+        }
+
+        this->inputs = neurons[0].size();
+        this->layers.clear();
+
+        for (int l = 1; l < count; l++) {
+            QuantizedLayer layer;
+            layer.inputs = neurons[l - 1].size();
+            layer.outputs = neurons[l].size();
+            layer.paddedInputs = (layer.inputs + SNN_QUANTIZED_ROW_ALIGNMENT - 1)
+                / SNN_QUANTIZED_ROW_ALIGNMENT * SNN_QUANTIZED_ROW_ALIGNMENT;
+
+            double range = maximum[l - 1] - minimum[l - 1];
+            layer.inputScale = range > 0 ? range / SNN_QUANTIZED_ACTIVATION_MAX : 1;
+            layer.inputZeroPoint = std::lround(-minimum[l - 1] / layer.inputScale);
+
+            layer.weights.resize((long)layer.outputs * layer.paddedInputs, 0);
+            layer.rowSums.resize(layer.outputs, 0);
+            layer.rowScales.resize(layer.outputs, 1);
+
+            SCLT::DoubleVector row(layer.inputs);
+            for (int o = 0; o < layer.outputs; o++) {
+                auto neuron = neurons[l][o];
+                std::fill(row.begin(), row.end(), 0.0);
+                for (const auto& synapse : neuron->inputSynapses) {
+                    row[synapse->inputNeuron->index] += synapse->getWeight();
+                }
+
+                double largest = 0;
+                for (const auto& weight : row) largest = std::max(largest, std::fabs(weight));
+                double scale = largest > 0 ? largest / SNN_QUANTIZED_WEIGHT_MAX : 1;
+
+                int8_t* quantized = layer.weights.data() + (long)o * layer.paddedInputs;
+                for (int i = 0; i < layer.inputs; i++) {
+                    quantized[i] = (int8_t)std::lround(row[i] / scale);
+                    layer.rowSums[o] += quantized[i];
+                }
+
+                layer.rowScales[o] = scale;
+                layer.activationFunctions.push_back(neuron->activationFunction);
+                layer.hasInputs.push_back(!neuron->isInput());
+            }
+
+            layer.softmax = Softmax::isLayer(layer.activationFunctions);
+            this->layers.push_back(layer);
+        }
+    };
+
+    SCLT::DoubleVector QuantizedNetwork::process(SCLT::DoubleVector input)
+    {
+        SCLT::DoubleVector values(this->inputs, 0);
+        for (int i = 0; i < this->inputs && i < input.size(); i++) values[i] = input[i];
+
+        std::vector<uint8_t> quantized;
+
+        for (int l = 0; l < this->layers.size(); l++) {
+            SPT_SCOPE_ARG("forward int8", l + 1);
+            auto& layer = this->layers[l];
+
+            quantized.assign(layer.paddedInputs, 0);
+            double inverseScale = 1.0 / layer.inputScale;
+            double offset = layer.inputZeroPoint + 0.5;
+            for (int i = 0; i < layer.inputs; i++) {
+                // clamping first makes the truncating conversion a round to nearest
+                double q = std::min((double)SNN_QUANTIZED_ACTIVATION_MAX, values[i] * inverseScale + offset);
+                quantized[i] = (uint8_t)std::max(0.0, q);
+            }
+
+            SCLT::DoubleVector next(layer.outputs, 0);
+            for (int o = 0; o < layer.outputs; o++) {
+                if (!layer.hasInputs[o]) continue;
+
+                int32_t accumulator = dotProduct(
+                    quantized.data(),
+                    layer.weights.data() + (long)o * layer.paddedInputs,
+                    layer.paddedInputs
+                );
+                double sum = layer.rowScales[o] * layer.inputScale
+                    * (accumulator - layer.inputZeroPoint * layer.rowSums[o]);
+
+                auto activationFunction = layer.activationFunctions[o];
+                next[o] = activationFunction == nullptr || layer.softmax ? sum : activationFunction->activate(sum);
+            }
+
+            if (layer.softmax) Softmax::normalize(next.data(), next.data(), next.size());
+
+            values.swap(next);
+        }
+
+        return values;
+    };
+
+    template<typename T>
+    static void WriteValue(std::ofstream& file, T value)
+    {
+        file.write((const char*)&value, sizeof(T));
+    };
+
+    template<typename T>
+    static T ReadValue(std::ifstream& file)
+    {
+        T value;
+        file.read((char*)&value, sizeof(T));
+        return value;
+    };
+
+    void QuantizedNetwork::store(std::string filePath)
+    {
+        SPT_SCOPE("store int8");
+        std::ofstream file(filePath, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::invalid_argument("could not open file \"" + filePath + "\"");
+        }
+
+        file << SNN_QUANTIZED_MAGIC;
+        WriteValue<int32_t>(file, this->inputs);
+        WriteValue<int32_t>(file, this->layers.size());
+
+        for (auto& layer : this->layers) {
+            WriteValue<int32_t>(file, layer.inputs);
+            WriteValue<int32_t>(file, layer.outputs);
+            WriteValue<int32_t>(file, layer.paddedInputs);
+            WriteValue<double>(file, layer.inputScale);
+            WriteValue<int32_t>(file, layer.inputZeroPoint);
+
+            for (int o = 0; o < layer.outputs; o++) {
+                auto activationFunction = layer.activationFunctions[o];
+                std::string id = activationFunction == nullptr ? SNN_AF_ID_IDENTITY : activationFunction->getId();
+                WriteValue<int32_t>(file, id.size());
+                file.write(id.data(), id.size());
+                WriteValue<char>(file, layer.hasInputs[o]);
+                WriteValue<double>(file, layer.rowScales[o]);
+                WriteValue<int32_t>(file, layer.rowSums[o]);
+            }
+
+            file.write((const char*)layer.weights.data(), layer.weights.size());
+        }
+    };
+
+    void QuantizedNetwork::load(std::string filePath)
+    {
+        SPT_SCOPE("load int8");
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::invalid_argument("could not open file \"" + filePath + "\"");
+        }
+
+        std::string magic(std::string(SNN_QUANTIZED_MAGIC).size(), '\0');
+        file.read(&magic[0], magic.size());
+        if (magic != SNN_QUANTIZED_MAGIC) {
+            throw std::invalid_argument("\"" + filePath + "\" is not a quantized network");
+        }
+
+        this->inputs = ReadValue<int32_t>(file);
+        this->layers.clear();
+        this->layers.resize(ReadValue<int32_t>(file));
+
+        for (auto& layer : this->layers) {
+            layer.inputs = ReadValue<int32_t>(file);
+            layer.outputs = ReadValue<int32_t>(file);
+            layer.paddedInputs = ReadValue<int32_t>(file);
+            layer.inputScale = ReadValue<double>(file);
+            layer.inputZeroPoint = ReadValue<int32_t>(file);
+
+            for (int o = 0; o < layer.outputs; o++) {
+                std::string id(ReadValue<int32_t>(file), '\0');
+                file.read(&id[0], id.size());
+                layer.activationFunctions.push_back(this->afRegistry->get(id));
+                layer.hasInputs.push_back(ReadValue<char>(file));
+                layer.rowScales.push_back(ReadValue<double>(file));
+                layer.rowSums.push_back(ReadValue<int32_t>(file));
+            }
+
+            layer.weights.resize((long)layer.outputs * layer.paddedInputs);
+            file.read((char*)layer.weights.data(), layer.weights.size());
+            layer.softmax = Softmax::isLayer(layer.activationFunctions);
+        }
+
+        if (!file) {
+            throw std::invalid_argument("\"" + filePath + "\" is truncated");
+        }
+    };
+};
@@ -1,10 +1,266 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cmath>
+#include <algorithm>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
 #include "../header/sclt.hpp"
 
 namespace SCLT
 {
+    static uint64_t MixBits(uint64_t z)
+    {
+        // splitmix64 finalizer
+        z += 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    };
+
+    uint64_t RandomHash(uint64_t seed, uint64_t counter)
+    {
+        return MixBits(MixBits(seed) + counter);
+    };
+
+    double RandomUniform(uint64_t seed, uint64_t counter)
+    {
+        return (RandomHash(seed, counter) >> 11) * 0x1.0p-53;
+    };
+
+    double RandomNormal(uint64_t seed, uint64_t counter)
+    {
+        double u1 = ((RandomHash(seed, 2 * counter) >> 11) + 1) * 0x1.0p-53;
+        double u2 = RandomUniform(seed, 2 * counter + 1);
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+    };
+
+    static thread_local bool insideThreadPool = false;
+
+    std::vector<int> CpuTopology::ParseCpuList(std::string list)
+    {
+        // e.g. "0-3,8,10-11"
+        std::vector<int> cpus;
+        for (auto& range : SplitString(list, ',')) {
+            if (range.find_first_of("0123456789") == std::string::npos) continue;
+            auto bounds = SplitString(range, '-');
+            int first = std::stoi(bounds[0]);
+            int last = bounds.size() > 1 ? std::stoi(bounds[1]) : first;
+            for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        }
+        return cpus;
+    };
+
+    void CpuTopology::discover()
+    {
+        this->nodeIds.clear();
+        this->nodes.clear();
+
+        std::vector<int> allowed;
+#ifdef __linux__
+        cpu_set_t mask;
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &mask)) allowed.push_back(cpu);
+            }
+        }
+#endif
+        auto isAllowed = [&allowed](int cpu) {
+            return allowed.empty() || std::find(allowed.begin(), allowed.end(), cpu) != allowed.end();
+        };
+
+        std::string root = "/sys/devices/system/node/";
+        if (FileExists(root + "online")) {
+            for (int node : ParseCpuList(ReadFromFile(root + "online"))) {
+                std::string path = root + "node" + std::to_string(node) + "/cpulist";
+                if (!FileExists(path)) continue;
+
+                std::vector<int> cpus;
+                for (int cpu : ParseCpuList(ReadFromFile(path))) {
+                    if (isAllowed(cpu)) cpus.push_back(cpu);
+                }
+                // nodes with memory only get no workers
+                if (cpus.empty()) continue;
+                this->nodeIds.push_back(node);
+                this->nodes.push_back(cpus);
+            }
+        }
+
+        if (!this->nodes.empty()) return;
+
+        std::vector<int> cpus;
+        std::string online = "/sys/devices/system/cpu/online";
+        if (FileExists(online)) {
+            for (int cpu : ParseCpuList(ReadFromFile(online))) {
+                if (isAllowed(cpu)) cpus.push_back(cpu);
+            }
+        }
+        if (cpus.empty()) cpus = allowed;
+        if (cpus.empty()) {
+            for (int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) cpus.push_back(cpu);
+        }
+        this->nodeIds.push_back(0);
+        this->nodes.push_back(cpus);
+    };
+
+    int CpuTopology::size()
+    {
+        int count = 0;
+        for (const auto& cpus : this->nodes) count += cpus.size();
+        return count;
+    };
+
+    // workers are dealt to the nodes in turn, so any number of them spreads the
+    // memory bandwidth over all sockets
+    int CpuTopology::getNode(int worker)
+    {
+        return worker % this->nodes.size();
+    };
+
+    int CpuTopology::getCpu(int worker)
+    {
+        auto& cpus = this->nodes[this->getNode(worker)];
+        return cpus[(worker / this->nodes.size()) % cpus.size()];
+    };
+
+    int CpuTopology::getCurrentNode()
+    {
+#ifdef __linux__
+        int cpu = sched_getcpu();
+        for (int n = 0; n < this->nodes.size(); n++) {
+            if (std::find(this->nodes[n].begin(), this->nodes[n].end(), cpu) != this->nodes[n].end()) return n;
+        }
+#endif
+        return 0;
+    };
+
+    CpuTopology* CpuTopology::shared()
+    {
+        static CpuTopology* topology = []() {
+            auto topology = new CpuTopology;
+            topology->discover();
+            return topology;
+        }();
+        return topology;
+    };
+
+    bool PinThread(int cpu)
+    {
+#ifdef __linux__
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+        return false;
+#endif
+    };
+
+    bool ThreadPool::pinShared = false;
+
+    ThreadPool::ThreadPool(int threads, bool pinned)
+    {
+        if (threads <= 0) threads = std::thread::hardware_concurrency();
+        this->pinned = pinned;
+
+        // the calling thread always works on its own jobs as well
+        for (int i = 1; i < threads; i++) {
+            this->workers.push_back(std::thread(&ThreadPool::work, this, i));
+        }
+    };
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->wakeUp.notify_all();
+        for (auto& worker : this->workers) worker.join();
+    };
+
+    int ThreadPool::size()
+    {
+        return this->workers.size() + 1;
+    };
+
+    void ThreadPool::runChunks()
+    {
+        while (true) {
+            int chunk = this->nextChunk.fetch_add(1);
+            if (chunk >= this->chunks) return;
+            int from = this->begin + chunk * this->chunkSize;
+            this->body(from, std::min(this->end, from + this->chunkSize));
+        }
+    };
+
+    void ThreadPool::work(int worker)
+    {
+        insideThreadPool = true;
+        if (this->pinned) PinThread(CpuTopology::shared()->getCpu(worker));
+        long seen = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wakeUp.wait(lock, [this, seen]() {
+                    return this->stopping || this->generation != seen;
+                });
+                if (this->stopping) return;
+                seen = this->generation;
+            }
+
+            this->runChunks();
+
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (--this->pending == 0) this->finished.notify_all();
+        }
+    };
+
+    void ThreadPool::parallelFor(int begin, int end, std::function<void(int, int)> body, int minChunk)
+    {
+        int count = end - begin;
+        if (count <= 0) return;
+
+        // nested calls and small ranges are not worth a hand-off
+        if (this->workers.empty() || insideThreadPool || count <= minChunk) {
+            body(begin, end);
+            return;
+        }
+
+        std::lock_guard<std::mutex> submit(this->submitMutex);
+        int chunkSize = std::max(minChunk, (count + this->size() * 4 - 1) / (this->size() * 4));
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->body = body;
+            this->begin = begin;
+            this->end = end;
+            this->chunkSize = chunkSize;
+            this->chunks = (count + chunkSize - 1) / chunkSize;
+            this->nextChunk = 0;
+            this->pending = this->workers.size();
+            this->generation++;
+        }
+        this->wakeUp.notify_all();
+
+        insideThreadPool = true;
+        this->runChunks();
+        insideThreadPool = false;
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->finished.wait(lock, [this]() { return this->pending == 0; });
+    };
+
+    ThreadPool* ThreadPool::shared()
+    {
+        // never destroyed, so it can still be used while static objects are torn down
+        static ThreadPool* pool = new ThreadPool(0, pinShared);
+        return pool;
+    };
+
     bool FileExists(const std::string path)
     {
         std::ifstream file(path);
@@ -32,7 +288,7 @@ namespace SCLT
         if (!file.is_open()) {
             throw std::invalid_argument("could not open file \"" + path + "\"");
         }
-        while (getline(file, line)) input = input + line;
+        while (getline(file, line)) input += line;
         file.close();
         return input;
     };
@@ -180,6 +436,7 @@ namespace SCLT
                 option.shortOption
             });
         }
+        longOptions.push_back({nullptr, 0, nullptr, 0});
         return longOptions;
     };
 
@@ -207,6 +464,7 @@ namespace SCLT
     CliArguments::CliArguments(int argc, char** argv, CliOptionSet options, int helpPadding)
     {
         this->options = options;
+        optind = 1;
 
         while (true) {
             const auto opt = getopt_long(
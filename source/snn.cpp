@@ -1,8 +1,12 @@
 #include <cmath>
 #include <stdexcept>
 #include <algorithm>
-#include <time.h>
+#include <set>
 #include "../header/snn.hpp"
+#include "../header/optimizer.hpp"
+#include "../header/engine.hpp"
+#include "../header/tuner.hpp"
+#include "../header/spt.hpp"
 
 namespace SNN
 {
@@ -16,7 +20,7 @@ namespace SNN
         return input;
     };
 
-    double Identity::derivative(double input)
+    double Identity::derivative(double sum, double value)
     {
         return 1;
     };
@@ -32,7 +36,7 @@ namespace SNN
         return 1.0;
     };
 
-    double Boolean::derivative(double input)
+    double Boolean::derivative(double sum, double value)
     {
         return 1;
     };
@@ -47,10 +51,9 @@ namespace SNN
         return 1.0 / (1.0 + pow(std::exp(1.0), -input));
     };
 
-    double Sigmoid::derivative(double input)
+    double Sigmoid::derivative(double sum, double value)
     {
-        float sigm = this->activate(input);
-        return sigm * (1 - sigm);
+        return value * (1 - value);
     };
 
     std::string HyperbolicTangent::getId()
@@ -65,10 +68,85 @@ namespace SNN
         return (epx - enx) / (epx + enx);
     };
 
-    double HyperbolicTangent::derivative(double input)
+    double HyperbolicTangent::derivative(double sum, double value)
     {
-        double tanh = this->activate(input);
-        return 1 - tanh * tanh;
+        return 1 - value * value;
+    };
+
+    std::string Softmax::getId()
+    {
+        return SNN_AF_ID_SOFTMAX;
+    };
+
+    double Softmax::activate(double input)
+    {
+        return input;
+    };
+
+    double Softmax::derivative(double sum, double value)
+    {
+        return 1;
+    };
+
+    bool Softmax::isLayer(const std::vector<ActivationFunction*>& activationFunctions)
+    {
+        int count = 0;
+        for (const auto& activationFunction : activationFunctions) {
+            if (activationFunction != nullptr && activationFunction->getId() == SNN_AF_ID_SOFTMAX) count++;
+        }
+
+        if (count > 0 && count < activationFunctions.size()) {
+            throw std::invalid_argument("Softmax has to be used by every neuron of its layer");
+        }
+        return count > 0;
+    };
+
+    void Softmax::normalize(const double* sums, double* values, int size)
+    {
+        if (size <= 0) return;
+        double largest = *std::max_element(sums, sums + size);
+
+        double total = 0;
+        for (int i = 0; i < size; i++) {
+            values[i] = std::exp(sums[i] - largest);
+            total += values[i];
+        }
+
+        double scale = 1.0 / total;
+        for (int i = 0; i < size; i++) values[i] *= scale;
+    };
+
+    int ArgMax(const SCLT::DoubleVector& output)
+    {
+        if (output.empty()) return -1;
+        return std::max_element(output.begin(), output.end()) - output.begin();
+    };
+
+    std::vector<int> TopK(const SCLT::DoubleVector& output, int k)
+    {
+        std::vector<int> indices(output.size());
+        for (int i = 0; i < indices.size(); i++) indices[i] = i;
+
+        k = std::max(0, std::min(k, (int)indices.size()));
+        std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [&output](int a, int b) {
+            return output[a] > output[b] || (output[a] == output[b] && a < b);
+        });
+        indices.resize(k);
+        return indices;
+    };
+
+    std::vector<int> MaskIndices(const std::vector<bool>& mask)
+    {
+        std::vector<int> indices;
+        for (int i = 0; i < mask.size(); i++) {
+            if (mask[i]) indices.push_back(i);
+        }
+        return indices;
+    };
+
+    ActivationFunctionRegistry::~ActivationFunctionRegistry()
+    {
+        for (auto& entry : this->registry) delete entry.second;
     };
 
     void ActivationFunctionRegistry::add(ActivationFunction* activationFunction)
@@ -76,6 +154,12 @@ namespace SNN
         this->registry[activationFunction->getId()] = activationFunction;
     };
 
+    bool ActivationFunctionRegistry::has(std::string id)
+    {
+        auto entry = this->registry.find(id);
+        return entry != this->registry.end() && entry->second != nullptr;
+    };
+
     ActivationFunction* ActivationFunctionRegistry::get(std::string id)
     {
         if (this->registry[id] == nullptr) {
@@ -85,70 +169,89 @@ namespace SNN
         return this->registry[id];
     };
 
-    double Synapse::getValue()
+    int Parameters::add(double weight)
     {
-        return this->inputNeuron->getValue() * this->weight;
+        this->weights.push_back(weight);
+        this->gradients.push_back(0);
+        this->ids.push_back(-1);
+        return this->weights.size() - 1;
     };
 
-    bool Neuron::isInput()
+    int Parameters::size()
     {
-        return (this->inputSynapses.size() == 0);
+        return this->weights.size();
     };
 
-    bool Neuron::isOutput()
+    void Parameters::clear()
     {
-        return (this->outputSynapses.size() == 0);
+        this->weights.clear();
+        this->gradients.clear();
+        this->ids.clear();
     };
 
-    void Neuron::reset()
+    void Parameters::remap(const std::vector<int>& source)
     {
-        this->value = 0;
-        this->smallDelta = 0;
-        this->cacheValue = false;
+        SCLT::DoubleVector weights(source.size(), 0);
+        SCLT::DoubleVector gradients(source.size(), 0);
+        std::vector<int> ids(source.size(), -1);
+
+        for (int i = 0; i < source.size(); i++) {
+            if (source[i] < 0) continue;
+            weights[i] = this->weights[source[i]];
+            gradients[i] = this->gradients[source[i]];
+            ids[i] = this->ids[source[i]];
+        }
+
+        this->weights.swap(weights);
+        this->gradients.swap(gradients);
+        this->ids.swap(ids);
     };
 
-    double Neuron::getValue()
+    double Synapse::getWeight()
     {
-        if (this->isInput() || this->cacheValue) return this->value;
-
-        double value = 0;
+        return this->parameters->weights[this->index];
+    };
 
-        for (const auto& synapse : this->inputSynapses) {
-            value += synapse->getValue();
-        }
+    void Synapse::setWeight(double weight)
+    {
+        this->parameters->weights[this->index] = weight;
+    };
 
-        if (this->activationFunction != nullptr) {
-            value = activationFunction->activate(value);
-        }
+    std::string Neuron::getId()
+    {
+        return (std::string)"N"
+            + SNN_NEURON_ID_DELIMITER + std::to_string(this->layer)
+            + SNN_NEURON_ID_DELIMITER + std::to_string(this->index);
+    };
 
-        this->cacheValue = true;
-        return this->value = value;
+    bool Neuron::isInput()
+    {
+        return (this->inputSynapses.size() == 0);
     };
 
-    void Neuron::learn(double expectedValue, double epsilon)
+    bool Neuron::isOutput()
     {
-        if (this->isInput()) return;
+        return (this->outputSynapses.size() == 0);
+    };
 
-        if (this->isOutput()) {
-            this->smallDelta = expectedValue - this->getValue();
+    bool LayerStructure::isStructured()
+    {
+        return this->type != SNN_LAYER_ID_DENSE;
+    };
 
-        } else {
-            this->smallDelta = 0;
-            for (const auto& synapse : this->outputSynapses) {
-                this->smallDelta += synapse->outputNeuron->smallDelta * synapse->previousWeight;
-            }
-        }
+    int LayerStructure::getNeuronCount()
+    {
+        return this->channels * this->height * this->width;
+    };
 
-        double bigDeltaFactor = 1;
-        if (this->activationFunction != nullptr) {
-            bigDeltaFactor = activationFunction->derivative(this->getValue());
-        }
+    int LayerStructure::getInputCount()
+    {
+        return this->inputChannels * this->inputHeight * this->inputWidth;
+    };
 
-        for (const auto& synapse : this->inputSynapses) {
-            double bigDelta = bigDeltaFactor * epsilon * this->smallDelta * synapse->inputNeuron->getValue();
-            synapse->previousWeight = synapse->weight;
-            synapse->weight += bigDelta;
-        }
+    int LayerStructure::getWindowSize()
+    {
+        return this->kernel * this->kernel;
     };
 
     Network::Network(ActivationFunctionRegistry* afRegistry)
@@ -157,48 +260,234 @@ namespace SNN
             afRegistry = new ActivationFunctionRegistry;
             afRegistry->add(new SNN::Sigmoid);
             afRegistry->add(new SNN::HyperbolicTangent);
+            afRegistry->add(new SNN::Softmax);
+            this->ownsRegistry = true;
         }
 
-        afRegistry->add(new SNN::Identity);
+        if (!afRegistry->has(SNN_AF_ID_IDENTITY)) afRegistry->add(new SNN::Identity);
         this->afRegistry = afRegistry;
+        this->optimizer = Optimizer::create(SNN_OPTIMIZER_ID_SGD);
+    };
+
+    Network::~Network()
+    {
+        // neurons and synapses go with their slabs
+        delete this->optimizer;
+        delete this->workspace;
+        if (this->ownsRegistry) delete this->afRegistry;
+    };
+
+    void Network::clear()
+    {
+        this->neurons.clear();
+        this->neuronSlab.clear();
+        this->synapseSlab.clear();
+        this->initializers.clear();
+        this->structures.clear();
+        this->parameters.clear();
+        this->invalidate();
+    };
+
+    void Network::invalidate()
+    {
+        this->compiled = false;
+        this->structureVersion++;
+        this->weightVersion++;
+    };
+
+    void Network::setOptimizer(std::string definition)
+    {
+        auto optimizer = Optimizer::create(definition);
+
+        if (optimizer->getId() == this->optimizer->getId()) {
+            // same algorithm: keep the accumulated state, only take the new settings
+            this->optimizer->setHyperParameters(optimizer->getHyperParameters());
+            delete optimizer;
+            return;
+        }
+
+        delete this->optimizer;
+        this->optimizer = optimizer;
     };
 
     Neuron* Network::addNeuron(int layerId, std::string activationFunctionId)
     {
         this->initLayerUpTo(layerId);
-        auto neuron = new Neuron;
+        this->invalidate();
+        auto neuron = this->neuronSlab.create();
         neuron->activationFunction = this->afRegistry->get(activationFunctionId);
-        neuron->id = (std::string)"N"
-            + SNN_NEURON_ID_DELIMITER + std::to_string(layerId)
-            + SNN_NEURON_ID_DELIMITER + std::to_string(this->neurons[layerId].size());
+        neuron->layer = layerId;
+        neuron->index = this->neurons[layerId].size();
         this->neurons[layerId].push_back(neuron);
         return neuron;
     };
 
+    Neuron* Network::getNeuron(int layer, int index)
+    {
+        if (layer < 0 || layer >= this->neurons.size()) return nullptr;
+        auto& neuronLayer = this->neurons[layer];
+
+        // indices only drift from the positions between removing neurons and compact()
+        if (index >= 0 && index < neuronLayer.size() && neuronLayer[index]->index == index) {
+            return neuronLayer[index];
+        }
+
+        for (const auto& neuron : neuronLayer) {
+            if (neuron->index == index) return neuron;
+        }
+
+        return nullptr;
+    };
+
+    // "N-<layer>-<index>" between id and last
+    static bool ParseNeuronId(const char* id, const char* last, int& layer, int& index)
+    {
+        if (last - id < 5 || id[0] != 'N' || id[1] != SNN_NEURON_ID_DELIMITER) return false;
+        char* end;
+        layer = std::strtol(id + 2, &end, 10);
+        if (end >= last || *end != SNN_NEURON_ID_DELIMITER) return false;
+        index = std::strtol(end + 1, &end, 10);
+        return end == last;
+    };
+
+    static bool ParseNeuronId(const std::string& id, int& layer, int& index)
+    {
+        return ParseNeuronId(id.c_str(), id.c_str() + id.size(), layer, index);
+    };
+
     Neuron* Network::getNeuron(std::string id)
     {
-        SCLT::StringVector query = SCLT::SplitString(id, '.');
+        int layer, index;
+        Neuron* neuron = nullptr;
+        if (ParseNeuronId(id, layer, index)) neuron = this->getNeuron(layer, index);
 
-        for (const auto& neuronLayer : this->neurons) {
-            for (const auto& neuron : neuronLayer) {
-                if (neuron->id == id) return neuron;
-            }
+        if (neuron == nullptr) {
+            throw std::invalid_argument("could not find neuron \"" + id + "\"");
         }
 
-        throw std::invalid_argument("could not find neuron \"" + id + "\"");
+        return neuron;
     };
 
     Synapse* Network::addSynapse(Neuron* leftNeuron, Neuron* rightNeuron, double weight)
     {
-        auto synapse = new Synapse;
+        this->invalidate();
+        auto synapse = this->synapseSlab.create();
         leftNeuron->outputSynapses.push_back(synapse);
         rightNeuron->inputSynapses.push_back(synapse);
         synapse->inputNeuron = leftNeuron;
         synapse->outputNeuron = rightNeuron;
-        synapse->weight = weight;
+        synapse->parameters = &this->parameters;
+        synapse->index = this->parameters.add(weight);
         return synapse;
     }
 
+    int Network::removeSynapses(std::function<bool(Synapse*)> predicate)
+    {
+        std::vector<Synapse*> removed;
+
+        for (const auto& neuronLayer : this->neurons) {
+            for (const auto& neuron : neuronLayer) {
+                for (const auto& synapse : neuron->inputSynapses) {
+                    if (predicate(synapse)) removed.push_back(synapse);
+                }
+            }
+        }
+
+        if (removed.empty()) return 0;
+
+        // flag by pointing nowhere, so every list is filtered in a single pass
+        for (const auto& synapse : removed) synapse->parameters = nullptr;
+        auto isRemoved = [](Synapse* synapse) { return synapse->parameters == nullptr; };
+
+        for (const auto& neuronLayer : this->neurons) {
+            for (const auto& neuron : neuronLayer) {
+                auto& inputs = neuron->inputSynapses;
+                auto& outputs = neuron->outputSynapses;
+                inputs.erase(std::remove_if(inputs.begin(), inputs.end(), isRemoved), inputs.end());
+                outputs.erase(std::remove_if(outputs.begin(), outputs.end(), isRemoved), outputs.end());
+            }
+        }
+
+        for (const auto& synapse : removed) this->synapseSlab.release(synapse);
+        this->invalidate();
+        return removed.size();
+    };
+
+    int Network::removeDeadNeurons()
+    {
+        int removed = 0;
+
+        // removing a neuron can leave its neighbours dead, so repeat until stable
+        while (true) {
+            std::vector<Neuron*> dead;
+            for (int l = 1; l + 1 < this->neurons.size(); l++) {
+                // structured layers and their inputs are connected without synapses
+                if (this->isStructured(l) || this->isStructured(l + 1)) continue;
+                for (const auto& neuron : this->neurons[l]) {
+                    if (neuron->isInput() || neuron->isOutput()) dead.push_back(neuron);
+                }
+            }
+
+            if (dead.empty()) break;
+
+            std::set<Neuron*> deadSet(dead.begin(), dead.end());
+            this->removeSynapses([&deadSet](Synapse* synapse) {
+                return deadSet.count(synapse->inputNeuron) > 0
+                    || deadSet.count(synapse->outputNeuron) > 0;
+            });
+
+            for (const auto& neuron : dead) {
+                auto& layer = this->neurons[neuron->layer];
+                layer.erase(std::remove(layer.begin(), layer.end(), neuron), layer.end());
+                this->structures.erase(neuron->layer);
+            }
+
+            for (const auto& neuron : dead) this->neuronSlab.release(neuron);
+            removed += dead.size();
+        }
+
+        this->invalidate();
+        return removed;
+    };
+
+    void Network::compact()
+    {
+        for (int l = 0; l < this->neurons.size(); l++) {
+            for (int i = 0; i < this->neurons[l].size(); i++) {
+                this->neurons[l][i]->index = i;
+            }
+        }
+
+        // keep the live parameters in their current order and drop the rest;
+        // a block is a synapse (size 1) or the weights of a structured layer
+        std::vector<std::pair<int*, int>> blocks;
+        for (const auto& neuronLayer : this->neurons) {
+            for (const auto& neuron : neuronLayer) {
+                for (const auto& synapse : neuron->inputSynapses) blocks.push_back({&synapse->index, 1});
+            }
+        }
+
+        for (auto& entry : this->structures) {
+            auto& structure = entry.second;
+            if (structure.size > 0) blocks.push_back({&structure.offset, structure.size});
+        }
+
+        std::sort(blocks.begin(), blocks.end(), [](std::pair<int*, int> a, std::pair<int*, int> b) {
+            return *a.first < *b.first;
+        });
+
+        std::vector<int> source;
+        for (const auto& block : blocks) {
+            int first = *block.first;
+            *block.first = source.size();
+            for (int i = 0; i < block.second; i++) source.push_back(first + i);
+        }
+
+        this->parameters.remap(source);
+        this->optimizer->remap(source);
+        this->invalidate();
+    };
+
     void Network::initLayerUpTo(int layerId)
     {
         while (this->neurons.size() < layerId+1) {
@@ -207,78 +496,256 @@ namespace SNN
         }
     };
 
-    void Network::addLayer(int numberOfNeurons, std::string activationFunctionId)
+    void Network::addLayer(int numberOfNeurons, std::string activationFunctionId, std::string initializerId)
     {
         int layerId = this->neurons.size();
+        this->initLayerUpTo(layerId);
         for (int i = 0; i < numberOfNeurons; i++) {
             this->addNeuron(layerId, activationFunctionId);
         }
+        this->initializers[layerId] = initializerId;
+    };
+
+    bool Network::isStructured(int layerId)
+    {
+        auto structure = this->structures.find(layerId);
+        return structure != this->structures.end() && structure->second.isStructured();
+    };
+
+    void Network::addShapedLayer(
+        int channels,
+        int height,
+        int width,
+        std::string activationFunctionId,
+        std::string initializerId
+    )
+    {
+        int layerId = this->neurons.size();
+        this->addLayer(channels * height * width, activationFunctionId, initializerId);
+
+        LayerStructure structure;
+        structure.channels = channels;
+        structure.height = height;
+        structure.width = width;
+        structure.inputChannels = channels;
+        structure.inputHeight = height;
+        structure.inputWidth = width;
+        this->structures[layerId] = structure;
+    };
+
+    void Network::addConvolutionLayer(
+        int channels,
+        int kernel,
+        int stride,
+        int padding,
+        std::string activationFunctionId,
+        std::string initializerId
+    )
+    {
+        int layerId = this->neurons.size();
+        if (this->structures.count(layerId - 1) == 0) {
+            throw std::invalid_argument("convolution layer " + std::to_string(layerId) + " needs the shape of the layer before");
+        }
+
+        auto& input = this->structures[layerId - 1];
+        if (channels < 1 || kernel < 1 || stride < 1 || padding < 0
+            || input.height + 2 * padding < kernel || input.width + 2 * padding < kernel
+        ) {
+            throw std::invalid_argument("invalid convolution layer " + std::to_string(layerId));
+        }
+
+        LayerStructure structure;
+        structure.type = SNN_LAYER_ID_CONVOLUTION;
+        structure.channels = channels;
+        structure.height = (input.height + 2 * padding - kernel) / stride + 1;
+        structure.width = (input.width + 2 * padding - kernel) / stride + 1;
+        structure.inputChannels = input.channels;
+        structure.inputHeight = input.height;
+        structure.inputWidth = input.width;
+        structure.kernel = kernel;
+        structure.stride = stride;
+        structure.padding = padding;
+
+        this->addLayer(structure.getNeuronCount(), activationFunctionId, initializerId);
+        this->structures[layerId] = structure;
+    };
+
+    void Network::addPoolingLayer(std::string type, int size, int stride, std::string activationFunctionId)
+    {
+        int layerId = this->neurons.size();
+        if (type != SNN_LAYER_ID_MAX_POOL && type != SNN_LAYER_ID_AVG_POOL) {
+            throw std::invalid_argument("no pooling layer with id \"" + type + "\"");
+        }
+        if (this->structures.count(layerId - 1) == 0) {
+            throw std::invalid_argument("pooling layer " + std::to_string(layerId) + " needs the shape of the layer before");
+        }
+
+        auto& input = this->structures[layerId - 1];
+        if (stride <= 0) stride = size;
+        if (size < 1 || input.height < size || input.width < size) {
+            throw std::invalid_argument("invalid pooling layer " + std::to_string(layerId));
+        }
+
+        LayerStructure structure;
+        structure.type = type;
+        structure.channels = input.channels;
+        structure.height = (input.height - size) / stride + 1;
+        structure.width = (input.width - size) / stride + 1;
+        structure.inputChannels = input.channels;
+        structure.inputHeight = input.height;
+        structure.inputWidth = input.width;
+        structure.kernel = size;
+        structure.stride = stride;
+
+        this->addLayer(structure.getNeuronCount(), activationFunctionId);
+        this->structures[layerId] = structure;
     };
 
     void Network::createSynapses()
     {
-        srand(time(0));
         int leftLayer = 0;
         for (const auto& leftNeurons : this->neurons) {
             int rightLayer = leftLayer+1;
             if (this->neurons.size()-1 < rightLayer) return;
+
+            int firstIndex = this->parameters.size();
+
+            if (this->isStructured(rightLayer)) {
+                auto& structure = this->structures[rightLayer];
+                if (structure.type == SNN_LAYER_ID_CONVOLUTION) {
+                    int window = structure.inputChannels * structure.getWindowSize();
+                    structure.offset = firstIndex;
+                    structure.size = structure.channels * window;
+                    for (int i = 0; i < structure.size; i++) this->parameters.add();
+                    this->initializeWeights(
+                        rightLayer,
+                        firstIndex,
+                        this->parameters.size(),
+                        window,
+                        structure.channels * structure.getWindowSize()
+                    );
+                }
+                leftLayer++;
+                continue;
+            }
+            auto& rightNeurons = this->neurons[rightLayer];
             for (const auto& leftNeuron : leftNeurons) {
-                for (const auto& rightNeuron : this->neurons[rightLayer]) {
-                    this->addSynapse(leftNeuron, rightNeuron, (rand() % 100) / 100.0);
+                leftNeuron->outputSynapses.reserve(leftNeuron->outputSynapses.size() + rightNeurons.size());
+            }
+            for (const auto& rightNeuron : rightNeurons) {
+                rightNeuron->inputSynapses.reserve(rightNeuron->inputSynapses.size() + leftNeurons.size());
+            }
+
+            for (const auto& leftNeuron : leftNeurons) {
+                for (const auto& rightNeuron : rightNeurons) {
+                    this->addSynapse(leftNeuron, rightNeuron);
                 }
             }
+
+            this->initializeWeights(
+                rightLayer,
+                firstIndex,
+                this->parameters.size(),
+                leftNeurons.size(),
+                this->neurons[rightLayer].size()
+            );
             leftLayer++;
         }
     };
 
+    void Network::initializeWeights(int layerId, int firstIndex, int lastIndex, int fanIn, int fanOut)
+    {
+        std::string scheme = SNN_DEFAULT_INITIALIZER;
+        if (this->initializers.count(layerId) > 0) scheme = this->initializers[layerId];
+
+        std::function<double(uint64_t)> draw;
+        uint64_t seed = this->seed;
+
+        if (scheme == SNN_INIT_ID_UNIFORM) {
+            draw = [seed](uint64_t i) { return SCLT::RandomUniform(seed, i); };
+        } else if (scheme == SNN_INIT_ID_XAVIER) {
+            double limit = std::sqrt(6.0 / std::max(1, fanIn + fanOut));
+            draw = [seed, limit](uint64_t i) { return (2.0 * SCLT::RandomUniform(seed, i) - 1.0) * limit; };
+        } else if (scheme == SNN_INIT_ID_HE) {
+            double deviation = std::sqrt(2.0 / std::max(1, fanIn));
+            draw = [seed, deviation](uint64_t i) { return SCLT::RandomNormal(seed, i) * deviation; };
+        } else {
+            throw std::invalid_argument("no weight initializer with id \"" + scheme + "\"");
+        }
+
+        // the parameter index is the counter, so the result does not depend on the thread count
+        double* weights = this->parameters.weights.data();
+        SCLT::ThreadPool::shared()->parallelFor(firstIndex, lastIndex, [weights, &draw](int from, int to) {
+            for (int i = from; i < to; i++) weights[i] = draw(i);
+        }, SNN_PARALLEL_INIT_CHUNK);
+    };
+
+    void Network::compile()
+    {
+        for (int l = 0; l + 1 < this->neurons.size(); l++) {
+            std::vector<ActivationFunction*> activationFunctions;
+            for (const auto& neuron : this->neurons[l]) activationFunctions.push_back(neuron->activationFunction);
+            if (Softmax::isLayer(activationFunctions)) {
+                throw std::invalid_argument("Softmax is only supported on the output layer");
+            }
+        }
+
+        // snapshots pinned by readers keep the engine they were published with
+        this->engine = std::make_shared<Engine>();
+        this->engine->sparseThreshold = this->sparseThreshold;
+        this->engine->compile(this);
+        if (this->tuner != nullptr) this->tuner->tune(this->engine.get(), this->parameters.weights.data());
+
+        if (this->workspace == nullptr) this->workspace = new Workspace;
+        this->compiled = true;
+    };
+
     SCLT::DoubleVector Network::process(
         SCLT::DoubleVector input,
         SCLT::DoubleVector expectedOutput,
         double epsilon
     )
     {
-        for (const auto& neurons : this->neurons) {
-            for (const auto& neuron : neurons) {
-                neuron->reset();
-            }
-        }
-
-        int index = 0;
-        for (const auto& neuron : this->neurons[0]) {
-            double value = 0;
-            if (input.size() > index) value = input[index];
-            neuron->value = value;
-            index++;
-        }
-
-        SCLT::DoubleVector output;
-        for (const auto& neuron : this->neurons.back()) {
-            output.push_back(neuron->getValue());
-        }
+        if (!this->compiled) this->compile();
 
+        this->engine->forward(this->parameters.weights.data(), this->workspace, input);
+        SCLT::DoubleVector output = this->engine->getOutput(this->workspace);
         if (expectedOutput.size() == 0) return output;
 
-        for(int i = this->neurons.size()-1; i >= 0; i--) {
-            index = 0;
-            for (const auto& neuron : this->neurons[i]) {
-                double expectedOutputValue = 0;
-                if (expectedOutput.size() > index) expectedOutputValue = expectedOutput[index];
-                neuron->learn(expectedOutputValue, epsilon);
-                index++;
-            }
-        }
+        this->engine->backward(
+            this->parameters.weights.data(),
+            this->parameters.gradients.data(),
+            this->workspace,
+            expectedOutput
+        );
 
+        SPT_SCOPE("optimizer");
+        this->optimizer->step(&this->parameters, epsilon);
+        this->weightVersion++;
         return output;
     };
 
+    SCLT::DoubleVector Network::processOutputs(SCLT::DoubleVector input, const std::vector<int>& outputs)
+    {
+        if (!this->compiled) this->compile();
+
+        SPT_SCOPE("forward cone");
+        auto cone = this->engine->getCone(outputs);
+        this->engine->forward(cone, this->parameters.weights.data(), this->workspace, input);
+        return this->engine->getOutput(this->workspace, cone);
+    };
+
     void Network::store(std::string filePath)
     {
+        SPT_SCOPE("store");
         std::string neuronSetup, synapseSetup;
         SCLT::PBag cmdBag, synapseCmdBag;
+        std::vector<int> synapseOrder;
 
         for (const auto& neuronLayer : this->neurons) {
             for (const auto& neuron : neuronLayer) {
-                std::string neuronId = neuron->id;
+                std::string id = neuron->getId();
+                std::string neuronId = id;
                 std::replace(
                     neuronId.begin(),
                     neuronId.end(),
@@ -295,53 +762,326 @@ namespace SNN
                 for (const auto& synapse : neuron->outputSynapses) {
                     SCLT::PBag command;
                     command.insert(SNN_SAVE_COMMAND_ADD_SYNAPSE);
-                    command.insert(neuron->id);
-                    command.insert(synapse->outputNeuron->id);
-                    command.insert(std::to_string(synapse->weight));
+                    command.insert(id);
+                    command.insert(synapse->outputNeuron->getId());
+                    command.insert(std::to_string(synapse->getWeight()));
                     synapseCmdBag.insert(command);
+                    synapseOrder.push_back(synapse->index);
                 }
             }
         }
 
+        // layer structures follow the synapses, so load() knows every neuron first
+        for (auto& entry : this->structures) {
+            auto& structure = entry.second;
+            SCLT::PBag command;
+            command.insert(SNN_SAVE_COMMAND_ADD_LAYER);
+            command.insert(std::to_string(entry.first));
+            command.insert(structure.type);
+            for (int value : {
+                structure.channels, structure.height, structure.width,
+                structure.inputChannels, structure.inputHeight, structure.inputWidth,
+                structure.kernel, structure.stride, structure.padding
+            }) {
+                command.insert(std::to_string(value));
+            }
+            for (int i = structure.offset; i < structure.offset + structure.size; i++) {
+                command.insert(std::to_string(this->parameters.weights[i]));
+                synapseOrder.push_back(i);
+            }
+            synapseCmdBag.insert(command);
+        }
+
+        if (this->journalGeneration > 0) {
+            SCLT::PBag command;
+            command.insert(SNN_SAVE_COMMAND_JOURNAL_GENERATION);
+            command.insert(std::to_string(this->journalGeneration));
+            synapseCmdBag.insert(command);
+        }
+
+        // parameter ids are the positions in this file from now on
+        std::fill(this->parameters.ids.begin(), this->parameters.ids.end(), -1);
+        for (int p = 0; p < synapseOrder.size(); p++) this->parameters.ids[synapseOrder[p]] = p;
+
         std::string out = cmdBag.toString(SCLT_PBAG_2_DELIMITER)
             + ";" + synapseCmdBag.toString(SCLT_PBAG_2_DELIMITER);
 
+        // optimizer state follows the synapse commands in the same order, which
+        // is also the order load() assigns parameter indices in
+        SCLT::PBag optimizerCmdBag = this->optimizer->store(synapseOrder);
+        if (optimizerCmdBag.size() > 0) {
+            out += ";" + optimizerCmdBag.toString(SCLT_PBAG_2_DELIMITER);
+        }
+
         SCLT::WriteToFile(filePath, out);
     };
 
+    // One slice of a model file. Neurons and synapses are parsed on the thread
+    // of the chunk, every other command is kept as a PBag and applied in order.
+    // Parameter positions count from the start of the chunk.
+    class LoadChunk
+    {
+    public:
+        const char* first = nullptr;
+        const char* last = nullptr;
+        std::vector<int> neuronLayers;
+        SCLT::StringVector neuronFunctions;
+        std::vector<int> endpoints;
+        SCLT::DoubleVector weights;
+        std::vector<int> positions;
+        std::vector<std::pair<int, SCLT::PBag>> commands;
+        int parameters = 0;
+        std::vector<int> inputSlots;
+        std::vector<int> outputSlots;
+        std::string error;
+    };
+
+    static void ParseChunk(LoadChunk& chunk)
+    {
+        std::vector<const char*> fields;
+
+        for (const char* record = chunk.first; record < chunk.last; ) {
+            const char* end = std::find(record, chunk.last, SCLT_PARAM_BAG_L1_DELIMITER);
+
+            fields.clear();
+            fields.push_back(record);
+            for (const char* c = record; c < end; c++) {
+                if (*c == SCLT_PARAM_BAG_L2_DELIMITER) fields.push_back(c + 1);
+            }
+            fields.push_back(end + 1);
+            int count = fields.size() - 1;
+            auto field = [&fields](int i) {
+                return std::string(fields[i], fields[i + 1] - 1);
+            };
+            auto is = [&fields](int i, const char* command) {
+                return fields[i + 1] - 1 - fields[i] == 2 && fields[i][0] == command[0] && fields[i][1] == command[1];
+            };
+
+            if (record == end) {
+                // empty record
+            } else if (is(0, SNN_SAVE_COMMAND_ADD_NEURON) && count >= 5) {
+                chunk.neuronLayers.push_back(std::atoi(fields[2]));
+                chunk.neuronFunctions.push_back(field(4));
+            } else if (is(0, SNN_SAVE_COMMAND_ADD_SYNAPSE) && count >= 4) {
+                int leftLayer, leftIndex, rightLayer, rightIndex;
+                char* weightEnd;
+                double weight = std::strtod(fields[3], &weightEnd);
+                if (!ParseNeuronId(fields[1], fields[2] - 1, leftLayer, leftIndex)
+                    || !ParseNeuronId(fields[2], fields[3] - 1, rightLayer, rightIndex)
+                    || weightEnd == fields[3]
+                ) {
+                    chunk.error = "invalid synapse \"" + std::string(record, end) + "\"";
+                    return;
+                }
+                chunk.endpoints.insert(chunk.endpoints.end(), {leftLayer, leftIndex, rightLayer, rightIndex});
+                chunk.weights.push_back(weight);
+                chunk.positions.push_back(chunk.parameters++);
+            } else {
+                auto command = SCLT::PBag::fromString(std::string(record, end), SCLT_PBAG_1_DELIMITER);
+                chunk.commands.emplace_back(chunk.parameters, command);
+                if (command.children[0].value == SNN_SAVE_COMMAND_ADD_LAYER) {
+                    chunk.parameters += std::max(0, command.size() - 12);
+                }
+            }
+
+            record = end + 1;
+        }
+    };
+
     void Network::load(std::string filePath)
     {
-        this->neurons.clear();
+        SPT_SCOPE("load");
+        this->clear();
+        this->journalGeneration = 0;
+        delete this->optimizer;
+        this->optimizer = Optimizer::create(SNN_OPTIMIZER_ID_SGD);
         std::string input = SCLT::ReadFromFile(filePath);
+        auto pool = SCLT::ThreadPool::shared();
 
-        auto commands = SCLT::PBag::fromString(input, SCLT_PBAG_2_DELIMITER);
-        for (auto& arguments : commands) {
-            if (arguments[0].value == SNN_SAVE_COMMAND_ADD_NEURON) {
-                this->addNeuron(
-                    std::atoi(arguments[2].value.c_str()),
-                    arguments[4].value
-                );
-            } else if (arguments[0].value == SNN_SAVE_COMMAND_ADD_SYNAPSE) {
-                Neuron* leftNeuron = this->getNeuron(arguments[1].value);
-                Neuron* rightNeuron = this->getNeuron(arguments[2].value);
-                this->addSynapse(
-                    leftNeuron,
-                    rightNeuron,
-                    std::stod(arguments[3].value)
-                );
+        // slices end behind a record delimiter
+        int count = std::max(1, std::min(pool->size(), (int)(input.size() / SNN_LOAD_CHUNK_BYTES)));
+        std::vector<LoadChunk> chunks(count);
+        const char* text = input.c_str();
+        const char* textEnd = text + input.size();
+        for (int c = 0; c < count; c++) {
+            chunks[c].first = c == 0 ? text : chunks[c - 1].last;
+            const char* target = std::max(chunks[c].first, text + (long)input.size() * (c + 1) / count);
+            const char* end = std::find(target, textEnd, SCLT_PARAM_BAG_L1_DELIMITER);
+            chunks[c].last = c + 1 == count || end == textEnd ? textEnd : end + 1;
+        }
+
+        {
+            SPT_SCOPE("parse");
+            pool->parallelFor(0, count, [&chunks](int from, int to) {
+                for (int c = from; c < to; c++) ParseChunk(chunks[c]);
+            });
+        }
+        for (const auto& chunk : chunks) {
+            if (!chunk.error.empty()) throw std::invalid_argument(chunk.error);
+        }
+
+        // neurons first, so synapses can refer to neurons of any chunk
+        for (const auto& chunk : chunks) {
+            for (int n = 0; n < chunk.neuronLayers.size(); n++) {
+                this->addNeuron(chunk.neuronLayers[n], chunk.neuronFunctions[n]);
+            }
+        }
+
+        std::vector<Neuron*> flat;
+        std::vector<int> layerStart;
+        for (const auto& neuronLayer : this->neurons) {
+            layerStart.push_back(flat.size());
+            flat.insert(flat.end(), neuronLayer.begin(), neuronLayer.end());
+        }
+        int neuronCount = flat.size();
+
+        // count the synapses of every neuron per chunk, endpoints become flat numbers
+        pool->parallelFor(0, count, [&](int from, int to) {
+            for (int c = from; c < to; c++) {
+                auto& chunk = chunks[c];
+                chunk.inputSlots.assign(neuronCount, 0);
+                chunk.outputSlots.assign(neuronCount, 0);
+                std::vector<int> resolved;
+
+                for (int k = 0; k < chunk.endpoints.size(); k += 2) {
+                    int layer = chunk.endpoints[k], index = chunk.endpoints[k + 1];
+                    if (layer < 0 || layer >= layerStart.size() || index < 0 || index >= this->neurons[layer].size()) {
+                        chunk.error = "could not find neuron \"N-" + std::to_string(layer) + "-" + std::to_string(index) + "\"";
+                        return;
+                    }
+                    resolved.push_back(layerStart[layer] + index);
+                }
+
+                for (int k = 0; k < resolved.size(); k += 2) {
+                    chunk.outputSlots[resolved[k]]++;
+                    chunk.inputSlots[resolved[k + 1]]++;
+                }
+                chunk.endpoints.swap(resolved);
             }
+        });
+        for (const auto& chunk : chunks) {
+            if (!chunk.error.empty()) throw std::invalid_argument(chunk.error);
         }
+
+        // prefix sums over the chunks give every chunk its first slot per neuron
+        pool->parallelFor(0, neuronCount, [&](int from, int to) {
+            for (int n = from; n < to; n++) {
+                int inputs = 0, outputs = 0;
+                for (auto& chunk : chunks) {
+                    int chunkInputs = chunk.inputSlots[n], chunkOutputs = chunk.outputSlots[n];
+                    chunk.inputSlots[n] = inputs;
+                    chunk.outputSlots[n] = outputs;
+                    inputs += chunkInputs;
+                    outputs += chunkOutputs;
+                }
+                flat[n]->inputSynapses.resize(inputs);
+                flat[n]->outputSynapses.resize(outputs);
+            }
+        }, SNN_PARALLEL_INIT_CHUNK);
+
+        std::vector<int> parameterStart, synapseStart;
+        int parameterCount = 0, synapseCount = 0;
+        for (const auto& chunk : chunks) {
+            parameterStart.push_back(parameterCount);
+            synapseStart.push_back(synapseCount);
+            parameterCount += chunk.parameters;
+            synapseCount += chunk.weights.size();
+        }
+
+        this->parameters.weights.resize(parameterCount);
+        this->parameters.gradients.assign(parameterCount, 0);
+        this->parameters.ids.resize(parameterCount);
+
+        std::vector<Synapse*> synapses(synapseCount);
+        for (auto& synapse : synapses) synapse = this->synapseSlab.create();
+
+        {
+            SPT_SCOPE("place synapses");
+            pool->parallelFor(0, count, [&](int from, int to) {
+                for (int c = from; c < to; c++) {
+                    auto& chunk = chunks[c];
+                    for (int k = 0; k < chunk.weights.size(); k++) {
+                        Neuron* left = flat[chunk.endpoints[2 * k]];
+                        Neuron* right = flat[chunk.endpoints[2 * k + 1]];
+                        auto synapse = synapses[synapseStart[c] + k];
+                        synapse->inputNeuron = left;
+                        synapse->outputNeuron = right;
+                        synapse->parameters = &this->parameters;
+                        synapse->index = parameterStart[c] + chunk.positions[k];
+                        this->parameters.weights[synapse->index] = chunk.weights[k];
+                        left->outputSynapses[chunk.outputSlots[layerStart[left->layer] + left->index]++] = synapse;
+                        right->inputSynapses[chunk.inputSlots[layerStart[right->layer] + right->index]++] = synapse;
+                    }
+                }
+            });
+        }
+
+        for (int c = 0; c < count; c++) {
+            for (auto& entry : chunks[c].commands) {
+                auto& arguments = entry.second.children;
+                if (arguments[0].value == SNN_SAVE_COMMAND_ADD_LAYER) {
+                    LayerStructure structure;
+                    structure.type = arguments[2].value;
+                    structure.channels = std::stoi(arguments[3].value);
+                    structure.height = std::stoi(arguments[4].value);
+                    structure.width = std::stoi(arguments[5].value);
+                    structure.inputChannels = std::stoi(arguments[6].value);
+                    structure.inputHeight = std::stoi(arguments[7].value);
+                    structure.inputWidth = std::stoi(arguments[8].value);
+                    structure.kernel = std::stoi(arguments[9].value);
+                    structure.stride = std::stoi(arguments[10].value);
+                    structure.padding = std::stoi(arguments[11].value);
+                    structure.offset = parameterStart[c] + entry.first;
+                    structure.size = arguments.size() - 12;
+                    for (int i = 12; i < arguments.size(); i++) {
+                        this->parameters.weights[structure.offset + i - 12] = std::stod(arguments[i].value);
+                    }
+                    this->structures[std::stoi(arguments[1].value)] = structure;
+                } else if (arguments[0].value == SNN_SAVE_COMMAND_JOURNAL_GENERATION) {
+                    this->journalGeneration = std::stol(arguments[1].value);
+                } else if (arguments[0].value == SNN_SAVE_COMMAND_OPTIMIZER) {
+                    delete this->optimizer;
+                    this->optimizer = Optimizer::create(arguments[1].value);
+                    this->optimizer->loadSettings(entry.second);
+                } else if (arguments[0].value == SNN_SAVE_COMMAND_OPTIMIZER_STATE) {
+                    this->optimizer->loadState(entry.second);
+                }
+            }
+        }
+
+        // parameters were placed in file order
+        for (int i = 0; i < this->parameters.size(); i++) this->parameters.ids[i] = i;
+        this->invalidate();
     };
 
     void Network::loadShort(std::string definition)
     {
-        this->neurons.clear();
+        this->clear();
+        this->optimizer->reset();
 
         auto layers = SCLT::PBag::fromString(definition, SCLT_PBAG_2_DELIMITER);
         for (auto& args : layers) {
             if (args.size() < 1) args.insert("1");
             if (args.size() < 2) args.insert(SNN_AF_ID_IDENTITY);
-            this->addLayer(std::stoi(args[0].value), args[1].value);
+            if (args.size() < 3) args.insert(SNN_DEFAULT_INITIALIZER);
+
+            // "10", "1:28:28" (channels:height:width), "Conv:channels:kernel[:stride[:padding]]"
+            // or "MaxPool:size[:stride]" / "AvgPool:size[:stride]"
+            auto layer = SCLT::SplitString(args[0].value, SNN_LAYER_DEFINITION_DELIMITER);
+            auto field = [&layer](int i, int otherwise) {
+                return i < layer.size() ? std::stoi(layer[i]) : otherwise;
+            };
+
+            if (layer[0] == SNN_LAYER_ID_CONVOLUTION) {
+                this->addConvolutionLayer(field(1, 1), field(2, 1), field(3, 1), field(4, 0), args[1].value, args[2].value);
+            } else if (layer[0] == SNN_LAYER_ID_MAX_POOL || layer[0] == SNN_LAYER_ID_AVG_POOL) {
+                this->addPoolingLayer(layer[0], field(1, 2), field(2, 0), args[1].value);
+            } else if (layer.size() > 1) {
+                int channels = layer.size() > 2 ? field(0, 1) : 1;
+                this->addShapedLayer(channels, field(layer.size() - 2, 1), field(layer.size() - 1, 1), args[1].value, args[2].value);
+            } else {
+                this->addLayer(std::stoi(args[0].value), args[1].value, args[2].value);
+            }
         }
 
         this->createSynapses();
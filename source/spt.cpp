@@ -0,0 +1,171 @@
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include "../header/spt.hpp"
+#include "../header/sclt.hpp"
+
+namespace SPT
+{
+    static std::atomic<bool> tracingEnabled(false);
+    static std::mutex registryMutex;
+    static std::vector<RingBuffer*> registry;
+    static thread_local RingBuffer* localBuffer = nullptr;
+
+    static RingBuffer* LocalBuffer()
+    {
+        if (localBuffer != nullptr) return localBuffer;
+
+        auto buffer = new RingBuffer;
+        buffer->events.resize(SPT_RING_CAPACITY);
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer->thread = registry.size() + 1;
+        registry.push_back(buffer);
+        return localBuffer = buffer;
+    };
+
+    void RingBuffer::push(const Event& event)
+    {
+        long long written = this->written.load(std::memory_order_relaxed);
+        this->events[written % this->events.size()] = event;
+        this->written.store(written + 1, std::memory_order_release);
+    };
+
+    std::vector<Event> RingBuffer::snapshot()
+    {
+        std::vector<Event> result;
+        long long size = this->events.size();
+        long long last = this->written.load(std::memory_order_acquire);
+        long long first = std::max(this->cleared.load(std::memory_order_relaxed), last - size);
+        for (long long i = std::max(first, 0LL); i < last; i++) {
+            result.push_back(this->events[i % size]);
+        }
+
+        // the owner may have wrapped around the oldest events meanwhile
+        std::atomic_thread_fence(std::memory_order_acquire);
+        long long overwritten = this->written.load(std::memory_order_relaxed) - size - std::max(first, 0LL);
+        if (overwritten > 0) result.erase(result.begin(), result.begin() + std::min<long long>(overwritten, result.size()));
+        return result;
+    };
+
+    Scope::Scope(const char* name, int arg)
+    {
+        this->name = name;
+        this->arg = arg;
+        this->start = tracingEnabled.load(std::memory_order_relaxed) ? Now() : -1;
+    };
+
+    Scope::~Scope()
+    {
+        if (this->start < 0) return;
+        LocalBuffer()->push({this->name, this->arg, this->start, Now() - this->start});
+    };
+
+    void Enable(bool enabled)
+    {
+        tracingEnabled = enabled;
+    };
+
+    bool IsEnabled()
+    {
+        return tracingEnabled;
+    };
+
+    long long Now()
+    {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch
+        ).count();
+    };
+
+    void Reset()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const auto& buffer : registry) buffer->cleared = buffer->written.load(std::memory_order_acquire);
+    };
+
+    static std::string EventName(const Event& event)
+    {
+        std::string name = event.name;
+        if (event.arg >= 0) name += "[" + std::to_string(event.arg) + "]";
+        return name;
+    };
+
+    std::string ToChromeJson()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::string json = "{\"traceEvents\":[";
+        char line[256];
+        bool first = true;
+
+        for (const auto& buffer : registry) {
+            for (const auto& event : buffer->snapshot()) {
+                snprintf(line, sizeof(line),
+                    "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    first ? "" : ",",
+                    event.name,
+                    buffer->thread,
+                    event.start / 1000.0,
+                    event.duration / 1000.0
+                );
+                json += line;
+                if (event.arg >= 0) json += ",\"args\":{\"index\":" + std::to_string(event.arg) + "}";
+                json += "}";
+                first = false;
+            }
+        }
+
+        return json + "\n],\"displayTimeUnit\":\"ns\"}\n";
+    };
+
+    std::string ToSummary()
+    {
+        struct Aggregate { long long count = 0; long long total = 0; long long max = 0; };
+        std::map<std::string, Aggregate> aggregates;
+
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (const auto& buffer : registry) {
+                for (const auto& event : buffer->snapshot()) {
+                    auto& aggregate = aggregates[EventName(event)];
+                    aggregate.count++;
+                    aggregate.total += event.duration;
+                    aggregate.max = std::max(aggregate.max, event.duration);
+                }
+            }
+        }
+
+        std::vector<std::pair<std::string, Aggregate>> sorted(aggregates.begin(), aggregates.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+            return a.second.total > b.second.total;
+        });
+
+        std::string summary;
+        char line[256];
+        snprintf(line, sizeof(line), "%-24s %10s %12s %12s %12s\n",
+            "scope", "count", "total ms", "mean us", "max us");
+        summary += line;
+
+        for (const auto& entry : sorted) {
+            snprintf(line, sizeof(line), "%-24s %10lld %12.3f %12.3f %12.3f\n",
+                entry.first.c_str(),
+                entry.second.count,
+                entry.second.total / 1e6,
+                entry.second.total / 1e3 / entry.second.count,
+                entry.second.max / 1e3
+            );
+            summary += line;
+        }
+
+        return summary;
+    };
+
+    void WriteChromeJson(std::string path)
+    {
+        SCLT::WriteToFile(path, ToChromeJson());
+    };
+}
@@ -1,23 +1,132 @@
 #include <sys/socket.h>
+#include <poll.h>
 #include <netinet/in.h>
+#include <netdb.h>
 #include <unistd.h>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <memory>
 #include <stdexcept>
 #include "../header/sts.hpp"
+#include "../header/sclt.hpp"
+#include "../header/spt.hpp"
 
 namespace STS
 {
+    TcpQueue::TcpQueue(int capacity, int workers)
+    {
+        this->capacity = capacity;
+        this->workers = workers;
+    };
+
     void TcpServer::addRequestEventListener(TcpListener* listener)
     {
         this->requestEventListener.push_back(listener);
     };
 
+    int TcpServer::addQueue(int capacity, int workers)
+    {
+        this->queues.push_back(new TcpQueue(capacity, workers));
+        return this->queues.size() - 1;
+    };
+
     TcpResponse* TcpServer::processRequest(TcpRequest* request)
     {
-        auto response = new TcpResponse;
+        SPT_SCOPE("server process");
+        std::unique_ptr<TcpResponse> response(new TcpResponse);
         for (const auto& listener : this->requestEventListener) {
-            listener->processRequest(request, response);
+            listener->processRequest(request, response.get());
+        }
+        return response.release();
+    };
+
+    // only called once poll() found the connection readable, so read() returns right away
+    void TcpServer::readRequest(int connection, TcpRequest* request, std::chrono::steady_clock::time_point arrival)
+    {
+        SPT_SCOPE("server read");
+
+        char buffer[STC_REQUEST_BUFFER_SIZE];
+        auto bytesRead = read(connection, buffer, sizeof(buffer) - 1);
+        if (bytesRead < 0) bytesRead = 0;
+        buffer[bytesRead] = '\0';
+        request->body = buffer;
+
+        long milliseconds = this->deadline;
+        std::string prefix = STC_DEADLINE_PREFIX;
+        if (request->body.compare(0, prefix.size(), prefix) == 0) {
+            auto lineEnd = request->body.find('\n');
+            milliseconds = std::atol(request->body.c_str() + prefix.size());
+            request->body.erase(0, lineEnd == std::string::npos ? request->body.size() : lineEnd + 1);
+        }
+
+        if (milliseconds > 0) request->deadline = arrival + std::chrono::milliseconds(milliseconds);
+    };
+
+    bool TcpServer::admit(int connection, TcpRequest* request)
+    {
+        int index = 0;
+        if (!this->requestEventListener.empty()) index = this->requestEventListener[0]->getQueue(request);
+        auto queue = this->queues[std::min(std::max(index, 0), (int)this->queues.size() - 1)];
+
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if (queue->pending.size() < queue->capacity) {
+                queue->pending.push_back({connection, request});
+                queue->admitted++;
+                queue->ready.notify_one();
+                return true;
+            }
+        }
+
+        queue->rejected++;
+        return false;
+    };
+
+    void TcpServer::work(TcpQueue* queue)
+    {
+        while (true) {
+            std::pair<int, TcpRequest*> next;
+            {
+                std::unique_lock<std::mutex> lock(queue->mutex);
+                queue->ready.wait(lock, [queue]() { return !queue->pending.empty(); });
+                next = queue->pending.front();
+                queue->pending.pop_front();
+            }
+
+            int connection = next.first;
+            auto request = next.second;
+
+            // shed before any compute, the client has given up on it anyway
+            if (std::chrono::steady_clock::now() > request->deadline) {
+                queue->expired++;
+                send(connection, STC_RESPONSE_EXPIRED, std::strlen(STC_RESPONSE_EXPIRED), MSG_NOSIGNAL);
+                close(connection);
+                delete request;
+                continue;
+            }
+
+            SPT_SCOPE("server request");
+            TcpResponse* response;
+            try {
+                response = this->processRequest(request);
+                queue->served++;
+            } catch (std::exception& e) {
+                // a malformed request only costs its own connection
+                response = new TcpResponse;
+                response->body = STC_RESPONSE_ERROR + std::string(e.what()) + "\n";
+                queue->failed++;
+            }
+
+            {
+                SPT_SCOPE("server send");
+                send(connection, response->body.c_str(), response->body.size(), MSG_NOSIGNAL);
+                close(connection);
+            }
+
+            delete request;
+            delete response;
         }
-        return response;
     };
 
     void TcpServer::listen(int port)
@@ -29,6 +138,9 @@ namespace STS
                 + std::to_string(errno));
         }
 
+        int reuse = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
         sockaddr_in sockaddr;
         sockaddr.sin_family = AF_INET;
         sockaddr.sin_addr.s_addr = INADDR_ANY;
@@ -45,25 +157,136 @@ namespace STS
                 + std::to_string(errno));
         }
 
+        if (this->queues.empty()) this->addQueue();
+        // workers of all queues are dealt to the cpus together, like a thread pool
+        int worker = 0;
+        for (auto queue : this->queues) {
+            for (int w = 0; w < queue->workers; w++, worker++) {
+                std::thread([this, queue, worker]() {
+                    if (this->pinned) SCLT::PinThread(SCLT::CpuTopology::shared()->getCpu(worker));
+                    this->work(queue);
+                }).detach();
+            }
+        }
+
         auto addrlen = sizeof(sockaddr);
 
+        // the listening socket first, then the accepted connections whose request did not arrive yet
+        std::vector<pollfd> sockets = {{sockfd, POLLIN, 0}};
+        std::vector<std::chrono::steady_clock::time_point> arrivals = {std::chrono::steady_clock::time_point::max()};
+        const auto readTimeout = std::chrono::milliseconds(STC_READ_TIMEOUT_MS);
+
         while(true) {
-            int connection = accept(sockfd, (struct sockaddr*)&sockaddr, (socklen_t*)&addrlen);
-            if (connection < 0) {
-                throw std::invalid_argument("Failed to grab connection. errno "
+            // wake up in time to drop the oldest silent connection
+            int timeout = -1;
+            auto now = std::chrono::steady_clock::now();
+            for (int s = 1; s < sockets.size(); s++) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(arrivals[s] + readTimeout - now).count();
+                timeout = std::max(0, timeout < 0 ? (int)left : std::min(timeout, (int)left));
+            }
+
+            if (poll(sockets.data(), sockets.size(), timeout) < 0) {
+                if (errno == EINTR) continue;
+                throw std::invalid_argument("Failed to poll connections. errno "
                     + std::to_string(errno));
             }
+            now = std::chrono::steady_clock::now();
+
+            for (int s = sockets.size() - 1; s > 0; s--) {
+                bool readable = sockets[s].revents != 0;
+                if (!readable && now - arrivals[s] < readTimeout) continue;
+
+                int connection = sockets[s].fd;
+                auto arrival = arrivals[s];
+                sockets.erase(sockets.begin() + s);
+                arrivals.erase(arrivals.begin() + s);
+
+                // nothing arrived within the read timeout
+                if (!readable) {
+                    close(connection);
+                    continue;
+                }
+
+                auto request = new TcpRequest;
+                this->readRequest(connection, request, arrival);
+                if (this->admit(connection, request)) continue;
+
+                send(connection, STC_RESPONSE_OVERLOADED, std::strlen(STC_RESPONSE_OVERLOADED), MSG_NOSIGNAL);
+                close(connection);
+                delete request;
+            }
 
-            char buffer[STC_REQUEST_BUFFER_SIZE];
-            auto bytesRead = read(connection, buffer, sizeof(buffer));
-            if (bytesRead > 0) buffer[bytesRead] = '\0';
-            auto request = new TcpRequest;
-            request->body = buffer;
-            auto response = this->processRequest(request);
-            send(connection, response->body.c_str(), response->body.size(), 0);
-            close(connection);
+            if (sockets[0].revents & POLLIN) {
+                int connection = accept(sockfd, (struct sockaddr*)&sockaddr, (socklen_t*)&addrlen);
+                if (connection < 0) {
+                    throw std::invalid_argument("Failed to grab connection. errno "
+                        + std::to_string(errno));
+                }
+                sockets.push_back({connection, POLLIN, 0});
+                arrivals.push_back(now);
+            }
         }
 
         close(sockfd);
     };
+
+    std::string TcpServer::toString()
+    {
+        std::string text;
+        for (int q = 0; q < this->queues.size(); q++) {
+            auto queue = this->queues[q];
+            text += (q == 0 ? "" : "\n") + std::string("queue ") + std::to_string(q)
+                + ": admitted " + std::to_string(queue->admitted)
+                + ", served " + std::to_string(queue->served)
+                + ", failed " + std::to_string(queue->failed)
+                + ", expired " + std::to_string(queue->expired)
+                + ", rejected " + std::to_string(queue->rejected);
+        }
+        return text;
+    };
+
+    TcpClient::TcpClient(std::string host, int port)
+    {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        // resolved once, requests only connect
+        addrinfo* result;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0) {
+            throw std::invalid_argument("could not resolve host \"" + host + "\"");
+        }
+        std::memcpy(&this->address, result->ai_addr, sizeof(this->address));
+        this->address.sin_port = htons(port);
+        freeaddrinfo(result);
+    };
+
+    std::string TcpClient::request(const std::string& body)
+    {
+        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd == -1) {
+            throw std::invalid_argument("Failed to create socket. errno: "
+                + std::to_string(errno));
+        }
+
+        if (connect(sockfd, (struct sockaddr*)&this->address, sizeof(this->address)) < 0) {
+            close(sockfd);
+            throw std::invalid_argument("Failed to connect to port "
+                + std::to_string(ntohs(this->address.sin_port)) + ". errno: "
+                + std::to_string(errno));
+        }
+
+        send(sockfd, body.c_str(), body.size(), MSG_NOSIGNAL);
+
+        std::string response;
+        char buffer[4096];
+        ssize_t bytesRead;
+        while ((bytesRead = read(sockfd, buffer, sizeof(buffer))) > 0) {
+            response.append(buffer, bytesRead);
+        }
+
+        close(sockfd);
+        return response;
+    };
 };
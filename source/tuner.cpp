@@ -0,0 +1,136 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "../header/tuner.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    KernelTuner::KernelTuner(std::string filePath)
+    {
+        this->filePath = filePath;
+        this->cpuModel = ReadCpuModel();
+        this->load();
+    };
+
+    std::string KernelTuner::ReadCpuModel()
+    {
+        std::ifstream file("/proc/cpuinfo");
+        std::string line;
+
+        while (getline(file, line)) {
+            if (line.compare(0, 10, "model name") != 0) continue;
+            std::string model = line.substr(line.find(':') + 1);
+            model.erase(0, model.find_first_not_of(" \t"));
+
+            // the name becomes one PBag value
+            std::replace(model.begin(), model.end(), SCLT_PARAM_BAG_L1_DELIMITER, ' ');
+            std::replace(model.begin(), model.end(), SCLT_PARAM_BAG_L2_DELIMITER, ' ');
+            if (!model.empty()) return model;
+        }
+
+        return SNN_TUNER_UNKNOWN_CPU;
+    };
+
+    std::string KernelTuner::getKey(LayerKernel* kernel)
+    {
+        return this->cpuModel + SCLT_PARAM_BAG_L2_DELIMITER + kernel->getShape();
+    };
+
+    void KernelTuner::load()
+    {
+        if (!SCLT::FileExists(this->filePath)) return;
+
+        auto records = SCLT::PBag::fromString(SCLT::ReadFromFile(this->filePath), SCLT_PBAG_2_DELIMITER);
+        for (const auto& record : records) {
+            if (record.children.size() < 4) continue;
+            const auto& fields = record.children;
+            this->blockings[fields[0].value + SCLT_PARAM_BAG_L2_DELIMITER + fields[1].value] = {
+                std::max(0, std::stoi(fields[2].value)),
+                std::max(1, std::stoi(fields[3].value))
+            };
+        }
+    };
+
+    void KernelTuner::store()
+    {
+        SCLT::PBag records;
+        for (const auto& entry : this->blockings) {
+            auto key = SCLT::PBag::fromString(entry.first, SCLT_PBAG_1_DELIMITER);
+            records.insert({
+                key.children[0].value,
+                key.children[1].value,
+                std::to_string(entry.second.first),
+                std::to_string(entry.second.second)
+            });
+        }
+
+        // other processes may read the cache at any time
+        std::string temporaryPath = this->filePath + ".tmp";
+        SCLT::WriteToFile(temporaryPath, records.toString(SCLT_PBAG_2_DELIMITER));
+        if (std::rename(temporaryPath.c_str(), this->filePath.c_str()) != 0) {
+            throw std::invalid_argument("could not replace file \"" + this->filePath + "\"");
+        }
+    };
+
+    void KernelTuner::tune(Engine* engine, const double* weights)
+    {
+        SPT_SCOPE("tune");
+        std::lock_guard<std::mutex> lock(this->mutex);
+        bool changed = false;
+
+        for (auto& layer : engine->layers) {
+            auto kernel = layer.kernel;
+            if (kernel == nullptr || kernel->getBlockings().size() < 2) continue;
+
+            std::string key = this->getKey(kernel);
+            auto known = this->blockings.find(key);
+            if (known == this->blockings.end()) {
+                known = this->blockings.insert({key, this->measure(kernel, weights + kernel->offset)}).first;
+                this->measured++;
+                changed = true;
+            } else {
+                this->reused++;
+            }
+
+            kernel->tile = known->second.first;
+            kernel->unroll = known->second.second;
+        }
+
+        if (changed) this->store();
+    };
+
+    std::pair<int, int> KernelTuner::measure(LayerKernel* kernel, const double* weights)
+    {
+        auto candidates = kernel->getBlockings();
+        std::vector<double> best(candidates.size(), -1);
+        SCLT::DoubleVector input(kernel->inputs), sums(kernel->outputs);
+        for (int i = 0; i < input.size(); i++) input[i] = SCLT::RandomUniform(kernel->inputs, i) + 0.01;
+
+        // rounds over all candidates even out frequency changes and noisy neighbours
+        for (int round = 0; round < SNN_TUNER_ROUNDS; round++) {
+            for (int c = 0; c < candidates.size(); c++) {
+                kernel->tile = candidates[c].first;
+                kernel->unroll = candidates[c].second;
+                kernel->forward(weights, input.data(), sums.data());
+
+                auto start = std::chrono::steady_clock::now();
+                double elapsed = 0;
+                long calls = 0;
+                while (elapsed < this->sampleSeconds / SNN_TUNER_ROUNDS) {
+                    kernel->forward(weights, input.data(), sums.data());
+                    calls++;
+                    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+
+                double perCall = elapsed / calls;
+                if (best[c] < 0 || perCall < best[c]) best[c] = perCall;
+            }
+        }
+
+        int winner = std::min_element(best.begin(), best.end()) - best.begin();
+        return candidates[winner];
+    };
+};
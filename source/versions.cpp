@@ -0,0 +1,116 @@
+#include <atomic>
+#include <algorithm>
+#include "../header/versions.hpp"
+#include "../header/spt.hpp"
+
+namespace SNN
+{
+    SCLT::DoubleVector WeightSnapshot::process(Workspace* workspace, const SCLT::DoubleVector& input) const
+    {
+        this->engine->forward(this->pointers.data(), workspace, input);
+        return this->engine->getOutput(workspace);
+    };
+
+    VersionedWeights::VersionedWeights(Network* network)
+    {
+        this->network = network;
+    };
+
+    std::shared_ptr<const WeightSnapshot> VersionedWeights::pin()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->current;
+    };
+
+    std::shared_ptr<const WeightSnapshot> VersionedWeights::pinLocal()
+    {
+        auto current = this->pin();
+        auto topology = SCLT::CpuTopology::shared();
+        if (!this->replicate || current == nullptr || topology->nodes.size() < 2) return current;
+
+        int node = topology->getCurrentNode();
+        std::lock_guard<std::mutex> lock(this->replicaMutex);
+        if (this->replicas.size() < topology->nodes.size()) this->replicas.resize(topology->nodes.size());
+
+        auto& replica = this->replicas[node];
+        if (replica.source == current) return replica.local;
+
+        // blocks are copied by the calling thread, so their pages are first
+        // touched on its node; blocks the source still shares are kept
+        auto local = std::make_shared<WeightSnapshot>();
+        local->version = current->version;
+        local->engine = current->engine;
+        bool sameLayout = replica.source != nullptr && replica.source->engine == current->engine;
+
+        for (int b = 0; b < current->blocks.size(); b++) {
+            if (sameLayout && replica.source->blocks[b] == current->blocks[b]) {
+                local->blocks.push_back(replica.local->blocks[b]);
+                continue;
+            }
+            local->blocks.push_back(std::make_shared<const SCLT::DoubleVector>(*current->blocks[b]));
+        }
+
+        for (const auto& block : local->blocks) local->pointers.push_back(block->data());
+
+        replica.source = current;
+        replica.local = local;
+        return local;
+    };
+
+    std::shared_ptr<SCLT::DoubleVector> VersionedWeights::getPage(int block, int size)
+    {
+        if (this->pages.size() <= block) this->pages.resize(block + 1);
+
+        // a page only referenced from here belongs to no snapshot any more
+        for (auto& page : this->pages[block]) {
+            if (page.use_count() == 1 && page->size() == size) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return page;
+            }
+        }
+
+        auto page = std::make_shared<SCLT::DoubleVector>(size);
+        this->pages[block].push_back(page);
+        return page;
+    };
+
+    long VersionedWeights::publish()
+    {
+        SPT_SCOPE("publish");
+        if (!this->network->compiled) this->network->compile();
+
+        auto previous = this->pin();
+        auto& weights = this->network->parameters.weights;
+        auto offsets = this->network->engine->getBlockOffsets(weights.size());
+        bool sameLayout = previous != nullptr && previous->engine == this->network->engine;
+
+        // pages of an old layout can never be shared again
+        if (!sameLayout) this->pages.clear();
+
+        auto snapshot = std::make_shared<WeightSnapshot>();
+        snapshot->version = previous == nullptr ? 1 : previous->version + 1;
+        snapshot->engine = this->network->engine;
+
+        for (int b = 0; b + 1 < offsets.size(); b++) {
+            const double* first = weights.data() + offsets[b];
+            int size = offsets[b + 1] - offsets[b];
+
+            if (sameLayout && std::equal(first, first + size, previous->blocks[b]->begin())) {
+                snapshot->blocks.push_back(previous->blocks[b]);
+                this->sharedBlocks++;
+                continue;
+            }
+
+            auto page = this->getPage(b, size);
+            std::copy(first, first + size, page->begin());
+            snapshot->blocks.push_back(page);
+            this->copiedBlocks++;
+        }
+
+        for (const auto& block : snapshot->blocks) snapshot->pointers.push_back(block->data());
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->current = snapshot;
+        return snapshot->version;
+    };
+};
@@ -0,0 +1,8 @@
+#!/bin/bash
+SCRIPT_DIR=$(realpath $(dirname "${BASH_SOURCE[0]}"))
+BUILD_DIR=$SCRIPT_DIR/../build
+
+OUTPUT=$BUILD_DIR/bench-$(date +%Y%m%d-%H%M%S).json
+
+$BUILD_DIR/snn-bench --output $OUTPUT "$@"
+echo "results written to $OUTPUT"
@@ -0,0 +1,6 @@
+#!/bin/bash
+SCRIPT_DIR=$(realpath $(dirname "${BASH_SOURCE[0]}"))
+BUILD_DIR=$SCRIPT_DIR/../build
+
+# exits non-zero when backprop and central differences disagree
+$BUILD_DIR/snn-bench --gradient-check
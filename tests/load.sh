@@ -0,0 +1,14 @@
+#!/bin/bash
+SCRIPT_DIR=$(realpath $(dirname "${BASH_SOURCE[0]}"))
+BUILD_DIR=$SCRIPT_DIR/../build
+
+PORT=${PORT:-8001}
+FILE=$BUILD_DIR/load.nn
+NETWORK="3;10,Identity;1"
+
+# any further arguments go to snn-loadgen, e.g. --connections 16 --rate 500
+trap "kill 0" EXIT
+$BUILD_DIR/neural-network -f $FILE -n "$NETWORK" -s $PORT &
+sleep 1
+
+$BUILD_DIR/snn-loadgen --port $PORT --inputs 3 "$@"